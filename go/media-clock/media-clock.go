@@ -0,0 +1,161 @@
+package mediaclock
+
+import (
+	"context"
+	"fmt"
+	"time"
+
+	rs "github.com/holoplot/ravenna-fpga-drivers/go/rtp-syncer"
+	rsd "github.com/holoplot/ravenna-fpga-drivers/go/stream-device"
+	ryd "github.com/holoplot/ravenna-fpga-drivers/go/sync-device"
+	"github.com/rs/zerolog/log"
+)
+
+// Change describes a media clock change and the streams it affects.
+type Change struct {
+	// Rate is the new system sample rate, in Hz.
+	Rate int
+
+	// MclkRate is the new MCLK rate, in Hz. Zero selects 512 times Rate.
+	MclkRate uint64
+
+	// LockTimeout bounds the wait for the PLL to lock. Zero selects the driver's default.
+	LockTimeout time.Duration
+
+	RxStreams []*rsd.RxStream
+	TxStreams []*rsd.TxStream
+
+	// AdjustRx and AdjustTx return the description a stream should be resumed with at
+	// the new rate, e.g. with a new RtpOffset or NumSamples. If nil, or for streams
+	// they return unchanged, the previous description is restored as it was.
+	AdjustRx func(sd rsd.RxStreamDescription, rate int) rsd.RxStreamDescription
+	AdjustTx func(sd rsd.TxStreamDescription, rate int) rsd.TxStreamDescription
+}
+
+// Result reports how long the steps of a change took.
+type Result struct {
+	LockTime  time.Duration
+	Outage    time.Duration
+	RtpOffset uint32
+}
+
+type Changer struct {
+	sd     *ryd.Device
+	syncer *rs.RtpSyncer
+}
+
+func New(sd *ryd.Device, syncer *rs.RtpSyncer) *Changer {
+	return &Changer{
+		sd:     sd,
+		syncer: syncer,
+	}
+}
+
+// Apply changes the media clock in a fixed order: it pauses all active streams, switches
+// MCLK and the system rate and waits for the PLL to lock, recomputes the RTP global
+// offset from the next PTP/RTP timestamp pair, and resumes the streams. The context
+// bounds the whole sequence. Streams are resumed even if a step fails, so that a failed
+// change does not leave them paused.
+func (c *Changer) Apply(ctx context.Context, ch Change) (Result, error) {
+	var res Result
+
+	rxDescs := make([]rsd.RxStreamDescription, len(ch.RxStreams))
+	txDescs := make([]rsd.TxStreamDescription, len(ch.TxStreams))
+
+	start := time.Now()
+
+	for i, rx := range ch.RxStreams {
+		rxDescs[i] = rx.Description()
+
+		if !rxDescs[i].Active {
+			continue
+		}
+
+		sd := rxDescs[i]
+		sd.Active = false
+
+		if err := rx.Update(sd); err != nil {
+			return res, c.resume(ch, rxDescs[:i], txDescs[:0], fmt.Errorf("failed to pause RX stream: %w", err))
+		}
+	}
+
+	for i, tx := range ch.TxStreams {
+		txDescs[i] = tx.Description()
+
+		if !txDescs[i].Active {
+			continue
+		}
+
+		sd := txDescs[i]
+		sd.Active = false
+
+		if err := tx.Update(sd); err != nil {
+			return res, c.resume(ch, rxDescs, txDescs[:i], fmt.Errorf("failed to pause TX stream: %w", err))
+		}
+	}
+
+	lockTime, err := c.sd.SetMediaClock(ch.Rate, ch.MclkRate, ch.LockTimeout)
+	if err != nil {
+		return res, c.resume(ch, rxDescs, txDescs, fmt.Errorf("failed to set media clock: %w", err))
+	}
+
+	res.LockTime = lockTime
+
+	c.syncer.SetSampleRate(ch.Rate)
+
+	res.RtpOffset, err = c.syncer.Resync(ctx)
+	if err != nil {
+		return res, c.resume(ch, rxDescs, txDescs, fmt.Errorf("failed to update RTP offset: %w", err))
+	}
+
+	for i := range rxDescs {
+		if ch.AdjustRx != nil {
+			rxDescs[i] = ch.AdjustRx(rxDescs[i], ch.Rate)
+		}
+	}
+
+	for i := range txDescs {
+		if ch.AdjustTx != nil {
+			txDescs[i] = ch.AdjustTx(txDescs[i], ch.Rate)
+		}
+	}
+
+	err = c.resume(ch, rxDescs, txDescs, nil)
+
+	res.Outage = time.Since(start)
+
+	log.Info().
+		Int("rate", ch.Rate).
+		Dur("lock-time", res.LockTime).
+		Dur("outage", res.Outage).
+		Uint32("rtp-offset", res.RtpOffset).
+		Msg("Media clock changed")
+
+	return res, err
+}
+
+// resume restores the given descriptions for the first len(rxDescs) RX and len(txDescs)
+// TX streams. It returns err if set, or else the first failure, and logs all others.
+func (c *Changer) resume(ch Change, rxDescs []rsd.RxStreamDescription, txDescs []rsd.TxStreamDescription, err error) error {
+	fail := func(e error) {
+		if err == nil {
+			err = e
+		} else {
+			log.Error().Err(e).Msg("Failed to resume stream")
+		}
+	}
+
+	for i, sd := range rxDescs {
+		if e := ch.RxStreams[i].Update(sd); e != nil {
+			fail(fmt.Errorf("failed to resume RX stream: %w", e))
+		}
+	}
+
+	for i, sd := range txDescs {
+		if e := ch.TxStreams[i].Update(sd); e != nil {
+			fail(fmt.Errorf("failed to resume TX stream: %w", e))
+		}
+	}
+
+	return err
+}
@@ -0,0 +1,93 @@
+package ravenna_ptp_device
+
+import (
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"io"
+	"os"
+	"syscall"
+	"unsafe"
+)
+
+// ExtTSEvent is one external timestamp event, see struct ra_ptp_extts_event
+type ExtTSEvent struct {
+	PTPTimestamp uint64
+	RTPTimestamp uint32
+	Sequence     uint32
+}
+
+// ExtTSStats mirrors struct ra_ptp_extts_stats
+type ExtTSStats struct {
+	Events      uint64
+	Overruns    uint64
+	HWOverflows uint64
+}
+
+const extTSEventSize = 16
+
+// RA_PTP_EXTTS_GET_STATS: _IOR('r', 0x50, struct ra_ptp_extts_stats)
+var ioctlExtTSGetStats = uint32(0x2<<30) |
+	uint32(unsafe.Sizeof(ExtTSStats{}))<<16 |
+	uint32('r')<<8 |
+	uint32(0x50)
+
+// ExtTSReader receives every external timestamp event the driver reports
+type ExtTSReader struct {
+	f   *os.File
+	buf []byte
+}
+
+func (d *Device) OpenExtTSReader() (*ExtTSReader, error) {
+	path := fmt.Sprintf("/dev/ptp%d-extts", d.index)
+
+	f, err := os.OpenFile(path, os.O_RDONLY, 0)
+	if err != nil {
+		return nil, fmt.Errorf("open failed: %w", err)
+	}
+
+	return &ExtTSReader{
+		f:   f,
+		buf: make([]byte, 64*extTSEventSize),
+	}, nil
+}
+
+// Read blocks until at least one event is available and returns all pending events
+func (r *ExtTSReader) Read() ([]ExtTSEvent, error) {
+	n, err := r.f.Read(r.buf)
+	if err != nil {
+		return nil, fmt.Errorf("read failed: %w", err)
+	}
+
+	if n%extTSEventSize != 0 {
+		return nil, io.ErrUnexpectedEOF
+	}
+
+	events := make([]ExtTSEvent, 0, n/extTSEventSize)
+
+	for b := r.buf[:n]; len(b) > 0; b = b[extTSEventSize:] {
+		events = append(events, ExtTSEvent{
+			PTPTimestamp: binary.LittleEndian.Uint64(b[0:]),
+			RTPTimestamp: binary.LittleEndian.Uint32(b[8:]),
+			Sequence:     binary.LittleEndian.Uint32(b[12:]),
+		})
+	}
+
+	return events, nil
+}
+
+func (r *ExtTSReader) Stats() (ExtTSStats, error) {
+	var stats ExtTSStats
+
+	_, _, errno := syscall.Syscall(syscall.SYS_IOCTL, r.f.Fd(),
+		uintptr(ioctlExtTSGetStats), uintptr(unsafe.Pointer(&stats)))
+	if errno != 0 {
+		return stats, errors.New(errno.Error())
+	}
+
+	return stats, nil
+}
+
+func (r *ExtTSReader) Close() error {
+	return r.f.Close()
+}
@@ -4,6 +4,7 @@ import (
 	"context"
 	"fmt"
 	"math/big"
+	"sync"
 	"time"
 
 	"github.com/holoplot/go-linuxptp/pkg/ptp"
@@ -16,11 +17,15 @@ type RtpSyncer struct {
 	pd *rpd.Device
 	nd *rnd.Device
 
+	// mu protects lastOffset and sampleRate, which SetSampleRate and Resync
+	// change while Run is active
+	mu         sync.Mutex
 	lastOffset uint32
 	sampleRate int
 }
 
-// globalWordClockCounter returns the current offset between PTP and RTP, in samples
+// globalWordClockCounter returns the current offset between PTP and RTP, in samples.
+// Must be called with s.mu held.
 func (s *RtpSyncer) globalWordClockCounter(ptpTimestamp uint64, rtpTimestamp uint32) uint32 {
 	// v = (ptpTimestamp * sampleRate / nanoSecondsPerSecond) - rtpTimestamp
 
@@ -42,6 +47,54 @@ func (s *RtpSyncer) globalWordClockCounter(ptpTimestamp uint64, rtpTimestamp uin
 	return uint32(r.Int64())
 }
 
+// SetSampleRate changes the sample rate the offset is computed for. Call Resync
+// afterwards to update the offset right away.
+func (s *RtpSyncer) SetSampleRate(sampleRate int) {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+
+	s.sampleRate = sampleRate
+}
+
+// Resync waits for a PTP/RTP timestamp pair that was taken after the call, and
+// sets the RTP global offset from it unconditionally.
+func (s *RtpSyncer) Resync(ctx context.Context) (uint32, error) {
+	lastPtpTimestamp, _, err := s.pd.GetTimestampPair()
+	if err != nil {
+		return 0, fmt.Errorf("failed to read timestamps: %w", err)
+	}
+
+	for {
+		select {
+		case <-time.After(10 * time.Millisecond):
+			ptpTimestamp, rtpTimestamp, err := s.pd.GetTimestampPair()
+			if err != nil {
+				return 0, fmt.Errorf("failed to read timestamps: %w", err)
+			}
+
+			if ptpTimestamp == lastPtpTimestamp {
+				continue
+			}
+
+			s.mu.Lock()
+			defer s.mu.Unlock()
+
+			offset := s.globalWordClockCounter(ptpTimestamp, rtpTimestamp)
+
+			if err := s.nd.SetRTPGlobalOffset(uint64(offset)); err != nil {
+				return 0, fmt.Errorf("failed to set timestamp: %w", err)
+			}
+
+			s.lastOffset = offset
+
+			return offset, nil
+
+		case <-ctx.Done():
+			return 0, ctx.Err()
+		}
+	}
+}
+
 type UpdateFunc func(ctx context.Context, s *RtpSyncer, oldOffset, newOffset uint32)
 
 func (s *RtpSyncer) Run(ctx context.Context, interval time.Duration, cb UpdateFunc) error {
@@ -55,17 +108,29 @@ func (s *RtpSyncer) Run(ctx context.Context, interval time.Duration, cb UpdateFu
 				continue
 			}
 
+			s.mu.Lock()
+
 			offset := s.globalWordClockCounter(ptpTimestamp, rtpTimestamp)
+			lastOffset := s.lastOffset
+			changed := offset > lastOffset+1 || offset < lastOffset-1
 
-			if offset > s.lastOffset+1 || offset < s.lastOffset-1 {
+			if changed {
 				if err := s.nd.SetRTPGlobalOffset(uint64(offset)); err != nil {
+					s.mu.Unlock()
+
 					return fmt.Errorf("failed to set timestamp: %w", err)
 				}
 
-				cb(ctx, s, s.lastOffset, offset)
 				s.lastOffset = offset
 			}
 
+			s.mu.Unlock()
+
+			// The callback runs unlocked, it may call back into the syncer
+			if changed {
+				cb(ctx, s, lastOffset, offset)
+			}
+
 		case <-ctx.Done():
 			return ctx.Err()
 		}
@@ -78,7 +78,18 @@ func (sd *RxStreamDescription) toIoctlStruct() []byte {
 }
 
 func (rx *RxStream) Update(sd RxStreamDescription) error {
-	return rx.device.updateRxStream(rx, sd)
+	if err := rx.device.updateRxStream(rx, sd); err != nil {
+		return err
+	}
+
+	rx.description = sd
+
+	return nil
+}
+
+// Description returns the description the stream was last added or updated with
+func (rx *RxStream) Description() RxStreamDescription {
+	return rx.description
 }
 
 func (rx *RxStream) Close() error {
@@ -94,7 +94,18 @@ func (sd *TxStreamDescription) toIoctlStruct() []byte {
 }
 
 func (tx *TxStream) Update(sd TxStreamDescription) error {
-	return tx.device.updateTxStream(tx, sd)
+	if err := tx.device.updateTxStream(tx, sd); err != nil {
+		return err
+	}
+
+	tx.description = sd
+
+	return nil
+}
+
+// Description returns the description the stream was last added or updated with
+func (tx *TxStream) Description() TxStreamDescription {
+	return tx.description
 }
 
 func (tx *TxStream) Close() error {
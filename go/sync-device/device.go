@@ -0,0 +1,61 @@
+package ravenna_sync_device
+
+import (
+	"errors"
+	"os"
+	"syscall"
+	"time"
+	"unsafe"
+)
+
+// mediaClock mirrors struct ra_sync_media_clock
+type mediaClock struct {
+	Rate       uint32
+	TimeoutMs  uint32
+	MclkRate   uint64
+	LockTimeNs uint64
+}
+
+// RA_SYNC_SET_MEDIA_CLOCK: _IOWR('r', 106, struct ra_sync_media_clock)
+var ioctlSetMediaClock = uint32(0x3<<30) |
+	uint32(unsafe.Sizeof(mediaClock{}))<<16 |
+	uint32('r')<<8 |
+	uint32(106)
+
+type Device struct {
+	f *os.File
+}
+
+func Open(path string) (*Device, error) {
+	f, err := os.OpenFile(path, os.O_RDWR, 0)
+	if err != nil {
+		return nil, err
+	}
+
+	return &Device{
+		f: f,
+	}, nil
+}
+
+// SetMediaClock switches MCLK and the system sample rate and waits for the PLL to lock.
+// A zero mclkRate selects 512 times the sample rate, and a zero timeout the driver's default.
+// It returns the time the PLL took to lock.
+func (d *Device) SetMediaClock(rate int, mclkRate uint64, timeout time.Duration) (time.Duration, error) {
+	mc := mediaClock{
+		Rate:      uint32(rate),
+		TimeoutMs: uint32(timeout / time.Millisecond),
+		MclkRate:  mclkRate,
+	}
+
+	_, _, errno := syscall.Syscall(syscall.SYS_IOCTL, d.f.Fd(),
+		uintptr(ioctlSetMediaClock), uintptr(unsafe.Pointer(&mc)))
+	if errno != 0 {
+		return 0, errors.New(errno.Error())
+	}
+
+	return time.Duration(mc.LockTimeNs), nil
+}
+
+func (d *Device) Close() error {
+	return d.f.Close()
+}
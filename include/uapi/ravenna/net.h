@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: MIT
+
+#ifndef _UAPI_RAVENNA_NET_H
+#define _UAPI_RAVENNA_NET_H
+
+#include <linux/types.h>
+
+/*
+ * Counter block exposed by the network driver as the binary sysfs
+ * attribute /sys/class/net/<device>/ra_net/counters. All counters are
+ * 64-bit accumulators of the 32-bit hardware counters and never wrap.
+ * New counters are only ever appended, so readers must check 'version'
+ * and only use the first 'num_counters' entries.
+ */
+
+#define RA_NET_COUNTERS_VERSION		1
+
+enum {
+	RA_NET_COUNTER_UDP_THROTTLED_PACKETS,
+	RA_NET_COUNTER_FIFO_ERRORS,
+
+	RA_NET_COUNTER_RX_PACKETS_PARSED,
+	RA_NET_COUNTER_RX_QUEUE_ERRORS,
+	RA_NET_COUNTER_RX_CHECKSUM_ERRORS,
+	RA_NET_COUNTER_RX_STREAM_PACKETS_DROPPED,
+	RA_NET_COUNTER_RX_STREAM_PACKETS,
+	RA_NET_COUNTER_RX_LEGACY_PACKETS,
+	RA_NET_COUNTER_RX_UNICAST_PACKETS,
+	RA_NET_COUNTER_RX_MULTICAST_PACKETS,
+	RA_NET_COUNTER_RX_BROADCAST_PACKETS,
+	RA_NET_COUNTER_RX_DROPPED_FRAMES,
+	RA_NET_COUNTER_RX_FCS_ERRORS,
+
+	RA_NET_COUNTER_TX_STREAM_PACKETS,
+	RA_NET_COUNTER_TX_LEGACY_PACKETS,
+	RA_NET_COUNTER_TX_STREAM_PACKETS_LOST,
+	RA_NET_COUNTER_TX_UNICAST_PACKETS,
+	RA_NET_COUNTER_TX_MULTICAST_PACKETS,
+	RA_NET_COUNTER_TX_BROADCAST_PACKETS,
+	RA_NET_COUNTER_TX_PAD_PACKETS,
+	RA_NET_COUNTER_TX_OVERSIZE_PACKETS,
+
+	RA_NET_COUNTER_MAX
+};
+
+/* RA_NET_LINK_SPEED_STATUS register layout */
+#define RA_NET_COUNTERS_LINK_UP			(1 << 0)
+#define RA_NET_COUNTERS_LINK_SPEED_MASK		(3 << 1)
+#define RA_NET_COUNTERS_LINK_SPEED_10		(0 << 1)
+#define RA_NET_COUNTERS_LINK_SPEED_100		(1 << 1)
+#define RA_NET_COUNTERS_LINK_SPEED_1000		(2 << 1)
+#define RA_NET_COUNTERS_LINK_FULL_DUPLEX	(1 << 3)
+
+struct ra_net_counters {
+	__u32 version;
+	__u32 num_counters;
+
+	/* CLOCK_MONOTONIC time of the snapshot */
+	__u64 timestamp_ns;
+
+	__u32 rtp_global_offset;
+	__u32 link_speed_status;
+
+	__u64 counters[RA_NET_COUNTER_MAX];
+};
+
+#endif /* _UAPI_RAVENNA_NET_H */
@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: MIT
+
+#ifndef _UAPI_RAVENNA_PTP_H
+#define _UAPI_RAVENNA_PTP_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/*
+ * One external timestamp event, as read() from /dev/ptp<N>-extts.
+ * rtp_ts is the RTP word clock counter at the event, or the event
+ * sequence count if the FPGA is set up to append that instead.
+ * seq is assigned by the driver and increments with every event
+ * the hardware reports, so gaps show events lost by the reader.
+ */
+struct ra_ptp_extts_event {
+	__u64 ptp_ns;
+	__u32 rtp_ts;
+	__u32 seq;
+};
+
+struct ra_ptp_extts_stats {
+	__u64 events;		/* events reported by the hardware */
+	__u64 overruns;		/* events dropped because this reader's queue was full */
+	__u64 hw_overflows;	/* hardware FIFO overflows */
+};
+
+/*
+ * PTP clock servo log entry, as exported in binary form by the
+ * servo_log.bin debugfs file. timestamp_ns is CLOCK_MONOTONIC.
+ */
+enum {
+	RA_PTP_SERVO_ADJFINE	= 0,	/* value: scaled_ppm */
+	RA_PTP_SERVO_ADJTIME	= 1,	/* value: offset in ns */
+	RA_PTP_SERVO_ADJPHASE	= 2,	/* value: offset in ns */
+	RA_PTP_SERVO_SETTIME	= 3,	/* value: new time in ns */
+};
+
+struct ra_ptp_servo_event {
+	__u64 timestamp_ns;
+	__s64 value;
+	__u32 type;
+	__u32 reserved;
+};
+
+#define RA_PTP_EXTTS_GET_STATS	_IOR('r', 0x50, struct ra_ptp_extts_stats)
+
+#endif /* _UAPI_RAVENNA_PTP_H */
@@ -8,6 +8,154 @@
 
 #include "types.h"
 
+/*
+ * Sync event, as read() from the sync device. timestamp_ns is
+ * CLOCK_MONOTONIC, taken when the interrupt was raised. source is the
+ * external sync source index, or -1 for events of the sync core itself.
+ * status is a snapshot of the source's status register, or of the main
+ * status register for core events. seq increments with every event, so
+ * gaps show events lost by the reader.
+ *
+ * For RA_SYNC_EVENT_SOURCE_SWITCH, source is the new sync source and
+ * status the previous one, both as RA_SYNC_SOURCE_* values. For
+ * RA_SYNC_EVENT_MEDIA_CLOCK, source is -1 and status the new system
+ * sample rate in Hz.
+ */
+enum {
+	RA_SYNC_EVENT_PLL_UNLOCK	= 0,
+	RA_SYNC_EVENT_PHASE_ADJUST	= 1,
+	RA_SYNC_EVENT_SIGNAL_DETECT	= 2,
+	RA_SYNC_EVENT_SAMPLE_RATE	= 3,
+	RA_SYNC_EVENT_TYPE		= 4,
+	RA_SYNC_EVENT_SOURCE_SWITCH	= 5,
+	RA_SYNC_EVENT_MEDIA_CLOCK	= 6,
+};
+
+struct ra_sync_event {
+	__u64 timestamp_ns;
+	__u32 type;
+	__s32 source;
+	__u32 status;
+	__u32 seq;
+};
+
+/* Sync sources, as selected in the main control register */
+#define RA_SYNC_SOURCE_EXT(n)		(n)
+#define RA_SYNC_SOURCE_PTP		0xa
+#define RA_SYNC_SOURCE_INTERNAL		0xb
+
+/*
+ * Automatic sync source failover. sources[] lists up to n_sources sync
+ * sources, highest priority first. When the active external source
+ * loses its signal or lock, the driver switches to the first usable
+ * source in the list. A source that becomes usable again has to stay
+ * usable for hold_off_ms before the driver switches back to it.
+ */
+#define RA_SYNC_FAILOVER_MAX_SOURCES	12
+
+struct ra_sync_failover_config {
+	__u32 enable;
+	__u32 hold_off_ms;
+	__u32 n_sources;
+	__u8 sources[RA_SYNC_FAILOVER_MAX_SOURCES];
+};
+
+/*
+ * Complete sync configuration. RA_SYNC_SET_CONFIG applies all of it in
+ * one locked sequence, in this order: MCLK rate, servo gains, DARS
+ * channel status, main control (sample rate, sync source, word clock
+ * generator), output 0, output 1. Sample rates are in Hz and must be
+ * one of 44100, 48000, 88200, 96000, 176400 or 192000. An mclk_rate of
+ * 0 leaves the MCLK untouched.
+ *
+ * version must be RA_SYNC_CONFIG_VERSION, and the reserved fields must
+ * be zero. RA_SYNC_GET_CONFIG returns the current configuration in the
+ * same format.
+ */
+#define RA_SYNC_CONFIG_VERSION		1
+#define RA_SYNC_SOURCE_NONE		0xc
+
+enum {
+	RA_SYNC_OUT_MODE_WCLK		= 0,
+	RA_SYNC_OUT_MODE_DARS		= 1,
+	RA_SYNC_OUT_MODE_PTP_PPS	= 2,
+};
+
+struct ra_sync_output_config {
+	__u32 enable;
+	__u32 mode;			/* RA_SYNC_OUT_MODE_* */
+	__u32 phase;			/* 0..255 */
+};
+
+struct ra_sync_config {
+	__u32 version;
+	__u32 sys_rate;			/* system sample rate, in Hz */
+	__u32 sync_source;		/* RA_SYNC_SOURCE_* */
+	__u32 wclk_gen_enable;
+	__u32 wclk_gen_rate;		/* word clock generator rate, in Hz */
+	__u32 wclk_gen_source;		/* external source index */
+	struct ra_sync_output_config out[2];
+	__u32 dars_cs[3];		/* AES3 output channel status */
+	__u32 servo_kp;			/* 0..65535 */
+	__u32 servo_ki;			/* 0..65535 */
+	__u32 reserved0;
+	__u64 mclk_rate;		/* in Hz */
+	__u32 reserved[8];
+};
+
+/*
+ * Sync status snapshot, read in one go. Reading it clears the sticky
+ * bits of the main status register, like any read of that register.
+ */
+#define RA_SYNC_N_EXT_SOURCES		10
+
+struct ra_sync_status {
+	__u32 version;			/* RA_SYNC_CONFIG_VERSION */
+	__u32 main_stat;		/* RA_SYNC_MAIN_STAT */
+	__u32 main_ctrl;		/* RA_SYNC_MAIN_CTRL */
+	__u32 servo_debug;		/* RA_SYNC_SRV_DEBUG */
+	__u32 ext_src_stat[RA_SYNC_N_EXT_SOURCES];
+	__u32 pll_locked;
+	__u32 active_source;		/* RA_SYNC_SOURCE_* */
+	__u64 mclk_rate;		/* in Hz */
+	__u64 source_switches;		/* by the failover logic */
+	__u32 reserved[8];
+};
+
+/*
+ * Servo debug sample, as read from the capture/data debugfs file.
+ * timestamp_ns is CLOCK_MONOTONIC. source is the sync source selected
+ * at the time, and source_stat its status register, or 0 if it is not
+ * an external source.
+ */
+struct ra_sync_servo_sample {
+	__u64 timestamp_ns;
+	__u32 servo_debug;		/* RA_SYNC_SRV_DEBUG */
+	__u32 main_stat;		/* RA_SYNC_MAIN_STAT */
+	__u32 source;			/* RA_SYNC_SOURCE_* */
+	__u32 source_stat;		/* RA_SYNC_EXT_SRC_STAT(source) */
+};
+
+/*
+ * Media clock change. The driver sets the MCLK rate (512 times the
+ * sample rate if mclk_rate is 0) and the system sample rate, and then
+ * waits up to timeout_ms (1000 if 0, at most 10000) for the PLL to
+ * lock. The time it took to lock is returned in lock_time_ns, and the
+ * ioctl fails with ETIMEDOUT if the PLL did not lock in time.
+ */
+struct ra_sync_media_clock {
+	__u32 rate;			/* system sample rate, in Hz */
+	__u32 timeout_ms;
+	__u64 mclk_rate;		/* in Hz */
+	__u64 lock_time_ns;		/* returned */
+};
+
 #define RA_SYNC_SET_MCLK_FREQUENCY	_IOW('r', 100, __u32)
+#define RA_SYNC_SET_FAILOVER		_IOW('r', 101, struct ra_sync_failover_config)
+#define RA_SYNC_GET_FAILOVER		_IOR('r', 102, struct ra_sync_failover_config)
+#define RA_SYNC_GET_CONFIG		_IOR('r', 103, struct ra_sync_config)
+#define RA_SYNC_SET_CONFIG		_IOW('r', 104, struct ra_sync_config)
+#define RA_SYNC_GET_STATUS		_IOR('r', 105, struct ra_sync_status)
+#define RA_SYNC_SET_MEDIA_CLOCK		_IOWR('r', 106, struct ra_sync_media_clock)
 
 #endif /* _UAPI_RAVENNA_SYNC_H */
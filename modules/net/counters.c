@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/netdevice.h>
+#include <linux/workqueue.h>
+
+#include <uapi/ravenna/net.h>
+
+#include "main.h"
+
+/*
+ * The hardware counters are 32 bits wide. At line rate, the fastest of
+ * them wraps after about 45 minutes, so this interval is far more than
+ * enough to keep the 64-bit accumulators exact. It is chosen to give the
+ * rate estimators a reasonable resolution.
+ */
+#define RA_NET_COUNTERS_POLL_INTERVAL	HZ
+
+static const u16 ra_net_counter_regs[RA_NET_COUNTER_MAX] = {
+	[RA_NET_COUNTER_UDP_THROTTLED_PACKETS]		= RA_NET_PP_CNT_UDP_THROTTLE,
+	[RA_NET_COUNTER_FIFO_ERRORS]			= RA_NET_FIFO_ERR_CNT,
+
+	[RA_NET_COUNTER_RX_PACKETS_PARSED]		= RA_NET_PP_CNT_RX_PARSED,
+	[RA_NET_COUNTER_RX_QUEUE_ERRORS]		= RA_NET_PP_CNT_RX_QUEUE_ERR,
+	[RA_NET_COUNTER_RX_CHECKSUM_ERRORS]		= RA_NET_PP_CNT_RX_IP_CHK_ERR,
+	[RA_NET_COUNTER_RX_STREAM_PACKETS_DROPPED]	= RA_NET_PP_CNT_RX_STREAM_DROP,
+	[RA_NET_COUNTER_RX_STREAM_PACKETS]		= RA_NET_PP_CNT_RX_STREAM,
+	[RA_NET_COUNTER_RX_LEGACY_PACKETS]		= RA_NET_PP_CNT_RX_LEGACY,
+	[RA_NET_COUNTER_RX_UNICAST_PACKETS]		= RA_NET_RX_UNICAST_PKT_CNT,
+	[RA_NET_COUNTER_RX_MULTICAST_PACKETS]		= RA_NET_RX_MULTICAST_PKT_CNT,
+	[RA_NET_COUNTER_RX_BROADCAST_PACKETS]		= RA_NET_RX_BROADCAST_PKT_CNT,
+	[RA_NET_COUNTER_RX_DROPPED_FRAMES]		= RA_NET_RX_DROPPED_FRAMES_CNT,
+	[RA_NET_COUNTER_RX_FCS_ERRORS]			= RA_NET_RX_FCS_ERR_CNT,
+
+	[RA_NET_COUNTER_TX_STREAM_PACKETS]		= RA_NET_PP_CNT_TX_STREAM,
+	[RA_NET_COUNTER_TX_LEGACY_PACKETS]		= RA_NET_PP_CNT_TX_LEGACY,
+	[RA_NET_COUNTER_TX_STREAM_PACKETS_LOST]		= RA_NET_PP_CNT_TX_STREAM_LOST,
+	[RA_NET_COUNTER_TX_UNICAST_PACKETS]		= RA_NET_TX_UNICAST_PKT_CNT,
+	[RA_NET_COUNTER_TX_MULTICAST_PACKETS]		= RA_NET_TX_MULTICAST_PKT_CNT,
+	[RA_NET_COUNTER_TX_BROADCAST_PACKETS]		= RA_NET_TX_BROADCAST_PKT_CNT,
+	[RA_NET_COUNTER_TX_PAD_PACKETS]			= RA_NET_TX_PAD_PKT_CNT,
+	[RA_NET_COUNTER_TX_OVERSIZE_PACKETS]		= RA_NET_TX_OVERSIZE_PKT_CNT,
+};
+
+/* Must be called with priv->counters.mutex held */
+static void ra_net_counters_accumulate(struct ra_net_priv *priv)
+{
+	struct ra_net_counters_acc *c = &priv->counters;
+	int i;
+
+	for (i = 0; i < RA_NET_COUNTER_MAX; i++) {
+		u32 v = ra_net_ior(priv, ra_net_counter_regs[i]);
+
+		c->acc[i] += (u32)(v - c->last[i]);
+		c->last[i] = v;
+	}
+}
+
+/* Must be called with priv->counters.mutex held */
+static void ra_net_counters_resync(struct ra_net_priv *priv)
+{
+	int i;
+
+	for (i = 0; i < RA_NET_COUNTER_MAX; i++)
+		priv->counters.last[i] = ra_net_ior(priv, ra_net_counter_regs[i]);
+}
+
+void ra_net_counters_snapshot(struct ra_net_priv *priv,
+			      struct ra_net_counters *snap)
+{
+	struct ra_net_counters_acc *c = &priv->counters;
+
+	BUILD_BUG_ON(ARRAY_SIZE(ra_net_counter_regs) !=
+		     ARRAY_SIZE(snap->counters));
+
+	memset(snap, 0, sizeof(*snap));
+
+	snap->version = RA_NET_COUNTERS_VERSION;
+	snap->num_counters = RA_NET_COUNTER_MAX;
+
+	mutex_lock(&c->mutex);
+
+	ra_net_counters_accumulate(priv);
+	memcpy(snap->counters, c->acc, sizeof(snap->counters));
+
+	snap->timestamp_ns = ktime_get_ns();
+	snap->rtp_global_offset = ra_net_ior(priv, RA_NET_RTP_GLOBAL_OFFSET);
+	snap->link_speed_status = ra_net_ior(priv, RA_NET_LINK_SPEED_STATUS);
+
+	mutex_unlock(&c->mutex);
+}
+
+/*
+ * Reset packet processor counters without disturbing the accumulators:
+ * account for everything counted so far, then restart from the new
+ * hardware values.
+ */
+void ra_net_counters_reset_hw(struct ra_net_priv *priv, u32 mask)
+{
+	mutex_lock(&priv->counters.mutex);
+
+	ra_net_counters_accumulate(priv);
+	ra_net_iow(priv, RA_NET_PP_CNT_RST, mask);
+	ra_net_counters_resync(priv);
+
+	mutex_unlock(&priv->counters.mutex);
+}
+
+/* Rate estimation */
+
+/* Must be called with priv->counters.mutex held */
+static void ra_net_rates_sample(struct ra_net_priv *priv, u64 *sample)
+{
+	const u64 *acc = priv->counters.acc;
+
+	sample[RA_NET_RATE_RX_STREAM_PACKETS] =
+		acc[RA_NET_COUNTER_RX_STREAM_PACKETS];
+	sample[RA_NET_RATE_RX_LEGACY_PACKETS] =
+		acc[RA_NET_COUNTER_RX_LEGACY_PACKETS];
+	sample[RA_NET_RATE_RX_LEGACY_BYTES] =
+		READ_ONCE(priv->ndev->stats.rx_bytes);
+	sample[RA_NET_RATE_TX_STREAM_PACKETS] =
+		acc[RA_NET_COUNTER_TX_STREAM_PACKETS];
+	sample[RA_NET_RATE_TX_STREAM_PACKETS_LOST] =
+		acc[RA_NET_COUNTER_TX_STREAM_PACKETS_LOST];
+	sample[RA_NET_RATE_TX_LEGACY_PACKETS] =
+		acc[RA_NET_COUNTER_TX_LEGACY_PACKETS];
+	sample[RA_NET_RATE_TX_LEGACY_BYTES] =
+		READ_ONCE(priv->ndev->stats.tx_bytes);
+}
+
+/*
+ * Update the exponentially weighted moving averages with the rates seen
+ * since the last sample. Each window's weight is the elapsed time divided
+ * by the window length, so irregular work scheduling does not skew the
+ * estimate.
+ *
+ * Must be called with priv->counters.mutex held.
+ */
+static void ra_net_rates_update(struct ra_net_priv *priv)
+{
+	struct ra_net_rates *r = &priv->counters.rates;
+	u64 sample[RA_NET_RATE_MAX];
+	u32 weight[RA_NET_RATE_WINDOWS];
+	u64 now = ktime_get_ns();
+	u64 dt = now - r->last_ns;
+	int i, w;
+
+	ra_net_rates_sample(priv, sample);
+
+	if (!dt)
+		return;
+
+	/* Weight of the new sample per window, in 1/65536 */
+	for (w = 0; w < RA_NET_RATE_WINDOWS; w++) {
+		u64 window = (u64)max(READ_ONCE(r->window_ms[w]), 1U) * NSEC_PER_MSEC;
+
+		weight[w] = dt >= window ? BIT(16) : div64_u64(dt << 16, window);
+	}
+
+	for (i = 0; i < RA_NET_RATE_MAX; i++) {
+		u64 delta = sample[i] - r->last[i];
+		s64 rate;
+
+		/* ndev->stats counters are unsigned long and wrap at 32 bits on 32-bit */
+		if (i == RA_NET_RATE_RX_LEGACY_BYTES ||
+		    i == RA_NET_RATE_TX_LEGACY_BYTES)
+			delta = (unsigned long)sample[i] - (unsigned long)r->last[i];
+
+		rate = mul_u64_u64_div_u64(delta, (u64)NSEC_PER_SEC * RA_NET_RATE_SCALE, dt);
+
+		for (w = 0; w < RA_NET_RATE_WINDOWS; w++) {
+			s64 diff = rate - (s64)r->rate[w][i];
+
+			r->rate[w][i] += (diff * (s64)weight[w]) >> 16;
+		}
+
+		r->last[i] = sample[i];
+	}
+
+	r->last_ns = now;
+}
+
+void ra_net_rates_read(struct ra_net_priv *priv, unsigned int window,
+		       u64 *rates)
+{
+	mutex_lock(&priv->counters.mutex);
+	memcpy(rates, priv->counters.rates.rate[window],
+	       sizeof(priv->counters.rates.rate[window]));
+	mutex_unlock(&priv->counters.mutex);
+}
+
+static void ra_net_counters_work(struct work_struct *work)
+{
+	struct ra_net_priv *priv =
+		container_of(work, struct ra_net_priv, counters.work.work);
+
+	mutex_lock(&priv->counters.mutex);
+	ra_net_counters_accumulate(priv);
+	ra_net_rates_update(priv);
+	mutex_unlock(&priv->counters.mutex);
+
+	schedule_delayed_work(&priv->counters.work, RA_NET_COUNTERS_POLL_INTERVAL);
+}
+
+static void ra_net_counters_cancel(void *data)
+{
+	struct ra_net_priv *priv = data;
+
+	cancel_delayed_work_sync(&priv->counters.work);
+}
+
+int ra_net_counters_init(struct ra_net_priv *priv)
+{
+	mutex_init(&priv->counters.mutex);
+	INIT_DELAYED_WORK(&priv->counters.work, ra_net_counters_work);
+
+	ra_net_counters_resync(priv);
+
+	priv->counters.rates.window_ms[RA_NET_RATE_WINDOW_SHORT] =
+		RA_NET_RATE_WINDOW_SHORT_MS;
+	priv->counters.rates.window_ms[RA_NET_RATE_WINDOW_LONG] =
+		RA_NET_RATE_WINDOW_LONG_MS;
+	priv->counters.rates.last_ns = ktime_get_ns();
+
+	schedule_delayed_work(&priv->counters.work, RA_NET_COUNTERS_POLL_INTERVAL);
+
+	return devm_add_action_or_reset(priv->dev, ra_net_counters_cancel, priv);
+}
@@ -0,0 +1,232 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <linux/debugfs.h>
+#include <linux/jump_label.h>
+#include <linux/math64.h>
+#include <linux/mutex.h>
+#include <linux/netdevice.h>
+#include <linux/seq_file.h>
+
+#include <ravenna/version.h>
+
+#include "main.h"
+
+DEFINE_STATIC_KEY_FALSE(ra_net_latency_key);
+static DEFINE_MUTEX(ra_net_latency_mutex);
+
+static int ra_net_summary_show(struct seq_file *s, void *p)
+{
+	struct ra_net_priv *priv = s->private;
+
+	seq_printf(s, "Driver version: %s\n", ra_driver_version());
+	seq_printf(s, "Interface: %s\n", netdev_name(priv->ndev));
+	seq_printf(s, "RX mode: %s\n", priv->dma_rx_chan ? "DMA" : "FIFO");
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(ra_net_summary);
+
+/* Latency instrumentation */
+
+static int ra_net_hist_show(struct seq_file *s, void *p)
+{
+	struct ra_net_hist *h = s->private;
+	int i;
+
+	for (i = 0; i < RA_NET_HIST_BUCKETS; i++) {
+		u64 count = READ_ONCE(h->buckets[i]);
+
+		if (!count)
+			continue;
+
+		if (i == 0)
+			seq_printf(s, "%10u            : %llu\n", 0, count);
+		else if (i == RA_NET_HIST_BUCKETS - 1)
+			seq_printf(s, "%10llu and above  : %llu\n",
+				   BIT_ULL(i - 1), count);
+		else
+			seq_printf(s, "%10llu - %10llu: %llu\n",
+				   BIT_ULL(i - 1), BIT_ULL(i) - 1, count);
+	}
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(ra_net_hist);
+
+static int ra_net_latency_enable_get(void *data, u64 *val)
+{
+	struct ra_net_priv *priv = data;
+
+	*val = priv->latency.enable;
+
+	return 0;
+}
+
+static int ra_net_latency_enable_set(void *data, u64 val)
+{
+	struct ra_net_priv *priv = data;
+	bool enable = !!val;
+
+	mutex_lock(&ra_net_latency_mutex);
+
+	if (enable != priv->latency.enable) {
+		priv->latency.irq_ns = 0;
+		WRITE_ONCE(priv->latency.enable, enable);
+
+		if (enable)
+			static_branch_inc(&ra_net_latency_key);
+		else
+			static_branch_dec(&ra_net_latency_key);
+	}
+
+	mutex_unlock(&ra_net_latency_mutex);
+
+	return 0;
+}
+
+DEFINE_DEBUGFS_ATTRIBUTE(ra_net_latency_enable_fops,
+			 ra_net_latency_enable_get,
+			 ra_net_latency_enable_set, "%llu\n");
+
+static int ra_net_latency_reset_set(void *data, u64 val)
+{
+	struct ra_net_priv *priv = data;
+
+	memset(&priv->latency.irq_to_poll, 0, sizeof(priv->latency.irq_to_poll));
+	memset(&priv->latency.fifo_read, 0, sizeof(priv->latency.fifo_read));
+	memset(&priv->latency.napi_batch, 0, sizeof(priv->latency.napi_batch));
+
+	return 0;
+}
+
+DEFINE_DEBUGFS_ATTRIBUTE(ra_net_latency_reset_fops,
+			 NULL, ra_net_latency_reset_set, "%llu\n");
+
+/* Traffic rates */
+
+static const char * const ra_net_rate_names[RA_NET_RATE_MAX] = {
+	[RA_NET_RATE_RX_STREAM_PACKETS]		= "RX stream packets/s",
+	[RA_NET_RATE_RX_LEGACY_PACKETS]		= "RX legacy packets/s",
+	[RA_NET_RATE_RX_LEGACY_BYTES]		= "RX legacy bytes/s",
+	[RA_NET_RATE_TX_STREAM_PACKETS]		= "TX stream packets/s",
+	[RA_NET_RATE_TX_STREAM_PACKETS_LOST]	= "TX stream packets lost/s",
+	[RA_NET_RATE_TX_LEGACY_PACKETS]		= "TX legacy packets/s",
+	[RA_NET_RATE_TX_LEGACY_BYTES]		= "TX legacy bytes/s",
+};
+
+static void ra_net_rates_print_utilization(struct seq_file *s, const char *dir,
+					   u64 bytes_per_sec, u32 mbit)
+{
+	/* Permille of the link rate, bytes_per_sec is scaled by RA_NET_RATE_SCALE */
+	u32 permille = div64_u64(bytes_per_sec * 8,
+				 (u64)mbit * 1000 * RA_NET_RATE_SCALE);
+
+	seq_printf(s, "  %s legacy link utilization: %u.%u%%\n",
+		   dir, permille / 10, permille % 10);
+}
+
+static int ra_net_rates_show(struct seq_file *s, void *p)
+{
+	struct ra_net_priv *priv = s->private;
+	u64 rates[RA_NET_RATE_WINDOWS][RA_NET_RATE_MAX];
+	u32 link, mbit;
+	int i, w;
+
+	for (w = 0; w < RA_NET_RATE_WINDOWS; w++)
+		ra_net_rates_read(priv, w, rates[w]);
+
+	seq_printf(s, "%-28s %18s %18s\n", "",
+		   "short window", "long window");
+
+	for (i = 0; i < RA_NET_RATE_MAX; i++) {
+		seq_printf(s, "%-28s", ra_net_rate_names[i]);
+
+		for (w = 0; w < RA_NET_RATE_WINDOWS; w++) {
+			u32 frac;
+			u64 v = div_u64_rem(rates[w][i], RA_NET_RATE_SCALE, &frac);
+
+			seq_printf(s, " %14llu.%03u", v, frac);
+		}
+
+		seq_puts(s, "\n");
+	}
+
+	link = ra_net_ior(priv, RA_NET_LINK_SPEED_STATUS);
+	if (!(link & RA_NET_LINK_SPEED_STATUS_UP)) {
+		seq_puts(s, "\nLink down\n");
+		return 0;
+	}
+
+	switch (link & RA_NET_LINK_SPEED_STATUS_SPEED_MASK) {
+	case RA_NET_LINK_SPEED_STATUS_SPEED_10:
+		mbit = 10;
+		break;
+	case RA_NET_LINK_SPEED_STATUS_SPEED_100:
+		mbit = 100;
+		break;
+	default:
+		mbit = 1000;
+		break;
+	}
+
+	seq_printf(s, "\nLink speed: %u Mbit/s, short window\n", mbit);
+	ra_net_rates_print_utilization(s, "RX",
+		rates[RA_NET_RATE_WINDOW_SHORT][RA_NET_RATE_RX_LEGACY_BYTES], mbit);
+	ra_net_rates_print_utilization(s, "TX",
+		rates[RA_NET_RATE_WINDOW_SHORT][RA_NET_RATE_TX_LEGACY_BYTES], mbit);
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(ra_net_rates);
+
+static void ra_net_remove_debugfs(void *data)
+{
+	struct ra_net_priv *priv = data;
+
+	debugfs_remove_recursive(priv->debugfs);
+	ra_net_latency_enable_set(priv, 0);
+}
+
+int ra_net_debugfs_init(struct ra_net_priv *priv)
+{
+	struct dentry *latency, *rates;
+	int ret;
+
+	priv->debugfs = debugfs_create_dir(dev_name(priv->dev), NULL);
+	if (IS_ERR(priv->debugfs))
+		return PTR_ERR(priv->debugfs);
+
+	ret = devm_add_action_or_reset(priv->dev, ra_net_remove_debugfs, priv);
+	if (ret < 0)
+		return ret;
+
+	debugfs_create_file("summary", 0444, priv->debugfs,
+			    priv, &ra_net_summary_fops);
+
+	latency = debugfs_create_dir("latency", priv->debugfs);
+
+	debugfs_create_file_unsafe("enable", 0644, latency,
+				   priv, &ra_net_latency_enable_fops);
+	debugfs_create_file_unsafe("reset", 0200, latency,
+				   priv, &ra_net_latency_reset_fops);
+	debugfs_create_file("irq_to_poll_ns", 0444, latency,
+			    &priv->latency.irq_to_poll, &ra_net_hist_fops);
+	debugfs_create_file("fifo_read_ns_per_word", 0444, latency,
+			    &priv->latency.fifo_read, &ra_net_hist_fops);
+	debugfs_create_file("napi_batch_size", 0444, latency,
+			    &priv->latency.napi_batch, &ra_net_hist_fops);
+
+	rates = debugfs_create_dir("rates", priv->debugfs);
+
+	debugfs_create_file("summary", 0444, rates,
+			    priv, &ra_net_rates_fops);
+	debugfs_create_u32("window_short_ms", 0644, rates,
+			   &priv->counters.rates.window_ms[RA_NET_RATE_WINDOW_SHORT]);
+	debugfs_create_u32("window_long_ms", 0644, rates,
+			   &priv->counters.rates.window_ms[RA_NET_RATE_WINDOW_LONG]);
+
+	return 0;
+}
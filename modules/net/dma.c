@@ -37,6 +37,12 @@ int ra_net_dma_probe(struct ra_net_priv *priv) {
 	}
 
 	/* RX */
+	spin_lock_init(&priv->dma_rx.lock);
+	priv->dma_rx.clean = 0;
+	priv->dma_rx.done = 0;
+	priv->dma_rx.fill = 0;
+	priv->dma_rx.refill = 0;
+
 	conf.direction = DMA_DEV_TO_MEM;
 	conf.dst_addr_width = DMA_SLAVE_BUSWIDTH_4_BYTES;
 	conf.src_addr_width = DMA_SLAVE_BUSWIDTH_4_BYTES;
@@ -66,157 +72,263 @@ int ra_net_dma_probe(struct ra_net_priv *priv) {
 	return 0;
 }
 
-void ra_net_dma_flush(struct ra_net_priv *priv) {
-	if (priv->dma_rx_chan)
-		dmaengine_terminate_all(priv->dma_rx_chan);
-}
-
-/* RX */
-
-struct ra_net_dma_rx_ctx {
-	struct ra_net_priv *priv;
-	struct sk_buff *skb;
-	dma_addr_t dma_addr;
-	bool timestamped;
-	size_t len, buf_len;
-};
-
-static int ra_net_dma_rx_one(struct ra_net_priv *priv);
-
-static void ra_net_dma_rx_callback(void *arg)
+static void ra_net_dma_rx_unmap(struct ra_net_priv *priv,
+				struct ra_net_dma_rx_buf *buf)
 {
-	struct ra_net_dma_rx_ctx *ctx = arg;
-	struct ra_net_priv *priv = ctx->priv;
-	struct device *dma_dev;
-
-	dma_dev = dmaengine_get_dma_device(priv->dma_rx_chan);
-
-	dma_unmap_single(dma_dev, ctx->dma_addr,
-			 ctx->buf_len, DMA_FROM_DEVICE);
+	struct device *dma_dev = dmaengine_get_dma_device(priv->dma_rx_chan);
 
-	/* FPGA inserts 2 padding bytes */
-	skb_reserve(ctx->skb, RA_NET_RX_PADDING_BYTES);
-	skb_put(ctx->skb, ctx->len);
+	dma_unmap_single(dma_dev, buf->dma_addr,
+			 RA_NET_DMA_RX_BUF_LEN, DMA_FROM_DEVICE);
+}
 
-	if (ctx->timestamped) {
-		struct ptp_packet_fpga_timestamp *ts =
-			(struct ptp_packet_fpga_timestamp *)
-				(ctx->skb->data + ctx->len);
+void ra_net_dma_flush(struct ra_net_priv *priv)
+{
+	struct ra_net_dma_rx *rx = &priv->dma_rx;
+	unsigned long flags;
+	int i;
 
-		ra_net_rx_apply_timestamp(priv, ctx->skb, ts);
-	}
+	if (!priv->dma_rx_chan)
+		return;
 
-	ctx->skb->protocol = eth_type_trans(ctx->skb, priv->ndev);
+	/*
+	 * Must be called with NAPI disabled. Wait for a running completion
+	 * callback too, before the ring buffers are freed.
+	 */
+	dmaengine_terminate_sync(priv->dma_rx_chan);
 
-	/* FPGA does IP checksum offload for receive packets */
-	ctx->skb->ip_summed = CHECKSUM_UNNECESSARY;
+	spin_lock_irqsave(&rx->lock, flags);
 
-	spin_lock(&priv->lock);
-	priv->ndev->stats.rx_packets++;
-	priv->ndev->stats.rx_bytes += ctx->len;
-	spin_unlock(&priv->lock);
+	for (i = 0; i < RA_NET_DMA_RX_RING_SIZE; i++) {
+		struct ra_net_dma_rx_buf *buf = &rx->ring[i];
 
-	netif_rx(ctx->skb);
+		if (!buf->skb)
+			continue;
 
-	if (netif_queue_stopped(priv->ndev))
-		netif_wake_queue(priv->ndev);
+		ra_net_dma_rx_unmap(priv, buf);
+		dev_kfree_skb_any(buf->skb);
+		buf->skb = NULL;
+	}
 
-	kfree(ctx);
+	rx->clean = 0;
+	rx->done = 0;
+	rx->fill = 0;
+	rx->refill = 0;
 
-	ra_net_dma_rx(priv);
+	spin_unlock_irqrestore(&rx->lock, flags);
 }
 
-static int ra_net_dma_rx_one(struct ra_net_priv *priv)
+static void ra_net_dma_rx_callback(void *arg);
+
+/*
+ * Start a transfer of the packet at the head of the FIFO into the next
+ * pre-mapped ring buffer. The FIFO only reports the length of the packet
+ * at its head, so there is at most one transfer in flight.
+ *
+ * Must be called with priv->dma_rx.lock held.
+ */
+static int ra_net_dma_rx_submit(struct ra_net_priv *priv)
 {
-	u32 status, pkt_len, buf_len;
+	struct ra_net_dma_rx *rx = &priv->dma_rx;
 	struct dma_async_tx_descriptor *tx;
-	struct ra_net_dma_rx_ctx *ctx;
-	struct device *dma_dev;
-	struct sk_buff *skb;
+	struct ra_net_dma_rx_buf *buf;
+	u32 status, pkt_len, len;
 	dma_cookie_t cookie;
-	dma_addr_t dma_addr;
-	bool timestamped;
 	int ret;
 
+	if (rx->fill != rx->done)
+		return -EBUSY;
+
+	if (rx->fill == rx->refill)
+		return -ENOBUFS;
+
 	status = ra_net_ior(priv, RA_NET_RX_STATE);
 	pkt_len = status & RA_NET_RX_STATE_PACKET_LEN_MASK;
-	timestamped = !!(status & RA_NET_RX_STATE_PACKET_HAS_PTP_TS);
 
 	if (pkt_len == 0)
 		return -ENOENT;
 
-	buf_len = pkt_len + RA_NET_RX_PADDING_BYTES;
-
-	if (timestamped)
-		buf_len += sizeof(struct ptp_packet_fpga_timestamp);
-
-	dma_dev = dmaengine_get_dma_device(priv->dma_rx_chan);
-
-	skb = netdev_alloc_skb(priv->ndev, buf_len+4);
-	if (unlikely(!skb)) {
-		priv->ndev->stats.rx_fifo_errors++;
-		return -ENOMEM;
-	}
-
-	dma_addr = dma_map_single(dma_dev, skb->data,
-				  buf_len, DMA_FROM_DEVICE);
-	if (dma_mapping_error(dma_dev, dma_addr)) {
-		dev_err(priv->dev, "Failed to DMA map buffer\n");
-		ret = -EIO;
-		goto err_free_skb;
-	}
+	buf = &rx->ring[rx->fill % RA_NET_DMA_RX_RING_SIZE];
+	buf->len = pkt_len;
+	buf->timestamped = !!(status & RA_NET_RX_STATE_PACKET_HAS_PTP_TS);
 
-	ctx = kzalloc(sizeof(struct ra_net_dma_rx_ctx), GFP_ATOMIC);
-	if (!ctx) {
-		ret = -ENOMEM;
-		goto err_unmap;
-	}
+	len = pkt_len + RA_NET_RX_PADDING_BYTES;
 
-	ctx->priv = priv;
-	ctx->skb = skb;
-	ctx->len = pkt_len;
-	ctx->buf_len = buf_len;
-	ctx->dma_addr = dma_addr;
-	ctx->timestamped = timestamped;
+	if (buf->timestamped)
+		len += sizeof(struct ptp_packet_fpga_timestamp);
 
-	tx = dmaengine_prep_dma_memcpy(priv->dma_rx_chan, dma_addr,
-				       priv->dma_addr, buf_len,
+	tx = dmaengine_prep_dma_memcpy(priv->dma_rx_chan, buf->dma_addr,
+				       priv->dma_addr, len,
 				       DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
 	if (!tx) {
 		dev_err(priv->dev, "dmaengine_prep_dma_memcpy failed\n");
-		ret = -EIO;
-		goto err_free_ctx;
+		return -EIO;
 	}
 
 	tx->callback = ra_net_dma_rx_callback;
-	tx->callback_param = ctx;
+	tx->callback_param = priv;
 
 	cookie = dmaengine_submit(tx);
 
 	ret = dma_submit_error(cookie);
 	if (ret) {
 		dev_err(priv->dev, "dma_submit_error %d\n", ret);
-		goto err_free_ctx;
+		return ret;
 	}
 
 	dma_async_issue_pending(priv->dma_rx_chan);
 
+	rx->fill++;
+
 	return 0;
+}
 
-err_free_ctx:
-	kfree(ctx);
-err_unmap:
-	dma_unmap_single(dma_dev, dma_addr, buf_len, DMA_FROM_DEVICE);
-err_free_skb:
-	kfree_skb(skb);
+/*
+ * Runs in the context of the DMA engine driver. Mark the buffer done and
+ * immediately chain the transfer of the next packet into the ring, so the
+ * DMA engine does not have to wait for NAPI to run. All packet processing
+ * is left to NAPI.
+ */
+static void ra_net_dma_rx_callback(void *arg)
+{
+	struct ra_net_priv *priv = arg;
+	struct ra_net_dma_rx *rx = &priv->dma_rx;
+	unsigned long flags;
+
+	spin_lock_irqsave(&rx->lock, flags);
+
+	/* Nothing is in flight if the ring was flushed in the meantime */
+	if (rx->done != rx->fill) {
+		rx->done++;
+		ra_net_dma_rx_submit(priv);
+	}
 
-	return ret;
+	spin_unlock_irqrestore(&rx->lock, flags);
+
+	napi_schedule(&priv->napi);
+}
+
+static void ra_net_dma_rx_deliver(struct ra_net_priv *priv,
+				  struct ra_net_dma_rx_buf *buf)
+{
+	struct sk_buff *skb = buf->skb;
+
+	buf->skb = NULL;
+	ra_net_dma_rx_unmap(priv, buf);
+
+	/* FPGA inserts 2 padding bytes */
+	skb_reserve(skb, RA_NET_RX_PADDING_BYTES);
+	skb_put(skb, buf->len);
+
+	if (buf->timestamped) {
+		struct ptp_packet_fpga_timestamp *ts =
+			(struct ptp_packet_fpga_timestamp *)
+				(skb->data + buf->len);
+
+		ra_net_rx_apply_timestamp(priv, skb, ts);
+	}
+
+	skb->protocol = eth_type_trans(skb, priv->ndev);
+
+	/* FPGA does IP checksum offload for receive packets */
+	skb->ip_summed = CHECKSUM_UNNECESSARY;
+
+	priv->ndev->stats.rx_packets++;
+	priv->ndev->stats.rx_bytes += buf->len;
+
+	napi_gro_receive(&priv->napi, skb);
 }
 
-void ra_net_dma_rx(struct ra_net_priv *priv) {
+/* Allocate and map buffers for all free ring slots */
+static void ra_net_dma_rx_refill(struct ra_net_priv *priv)
+{
+	struct device *dma_dev = dmaengine_get_dma_device(priv->dma_rx_chan);
+	struct ra_net_dma_rx *rx = &priv->dma_rx;
+	unsigned int refill = rx->refill;
+	unsigned long flags;
+
+	while (refill - rx->clean < RA_NET_DMA_RX_RING_SIZE) {
+		struct ra_net_dma_rx_buf *buf =
+			&rx->ring[refill % RA_NET_DMA_RX_RING_SIZE];
+		struct sk_buff *skb;
+		dma_addr_t dma_addr;
+
+		skb = napi_alloc_skb(&priv->napi, RA_NET_DMA_RX_BUF_LEN);
+		if (unlikely(!skb)) {
+			priv->ndev->stats.rx_fifo_errors++;
+			break;
+		}
+
+		dma_addr = dma_map_single(dma_dev, skb->data,
+					  RA_NET_DMA_RX_BUF_LEN, DMA_FROM_DEVICE);
+		if (dma_mapping_error(dma_dev, dma_addr)) {
+			dev_err(priv->dev, "Failed to DMA map buffer\n");
+			kfree_skb(skb);
+			break;
+		}
+
+		buf->skb = skb;
+		buf->dma_addr = dma_addr;
+		refill++;
+	}
+
+	spin_lock_irqsave(&rx->lock, flags);
+	rx->refill = refill;
+	spin_unlock_irqrestore(&rx->lock, flags);
+}
+
+/*
+ * Deliver the completed ring buffers through GRO, refill the ring in one
+ * go, and make sure a transfer is running if the FIFO holds more packets.
+ * NAPI is rescheduled by the DMA completions; once the FIFO is empty, the
+ * RX interrupt takes over again.
+ */
+int ra_net_dma_napi_poll(struct napi_struct *napi, int budget)
+{
+	struct ra_net_priv *priv = container_of(napi, struct ra_net_priv, napi);
+	struct ra_net_dma_rx *rx = &priv->dma_rx;
+	unsigned int done;
+	unsigned long flags;
+	int count = 0;
 	int ret;
 
-	ret = ra_net_dma_rx_one(priv);
-	if (ret == -ENOENT)
+	spin_lock_irqsave(&rx->lock, flags);
+	done = rx->done;
+	spin_unlock_irqrestore(&rx->lock, flags);
+
+	while (rx->clean != done && count < budget) {
+		ra_net_dma_rx_deliver(priv,
+			&rx->ring[rx->clean % RA_NET_DMA_RX_RING_SIZE]);
+
+		spin_lock_irqsave(&rx->lock, flags);
+		rx->clean++;
+		spin_unlock_irqrestore(&rx->lock, flags);
+
+		count++;
+	}
+
+	ra_net_dma_rx_refill(priv);
+	ra_net_tx_maybe_wake(priv);
+
+	if (count == budget)
+		return budget;
+
+	spin_lock_irqsave(&rx->lock, flags);
+	ret = ra_net_dma_rx_submit(priv);
+	done = rx->done;
+	spin_unlock_irqrestore(&rx->lock, flags);
+
+	/* More buffers completed while we were busy */
+	if (done != rx->clean)
+		return budget;
+
+	napi_complete_done(napi, count);
+
+	/*
+	 * Unless a transfer is in flight, whose completion reschedules NAPI,
+	 * wait for the next RX interrupt.
+	 */
+	if (ret < 0 && ret != -EBUSY)
 		ra_net_irq_enable(priv, RA_NET_IRQ_RX_PACKET_AVAILABLE);
+
+	return count;
 }
@@ -1,11 +1,15 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include <linux/etherdevice.h>
+#include <linux/iopoll.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/netdevice.h>
 #include <linux/of_mdio.h>
 #include <linux/of_net.h>
 #include <linux/ethtool.h>
 #include <linux/phylink.h>
+#include <linux/sizes.h>
 #include <linux/of_platform.h>
 #include <uapi/linux/net_tstamp.h>
 
@@ -35,6 +39,42 @@ static const char ra_net_gstrings_stats[][ETH_GSTRING_LEN] = {
 	"tx_broadcast_packets",
 	"tx_pad_packets",
 	"tx_oversize_packets",
+	"tx_queue_stops",
+
+	"rx_stream_packets_per_sec",
+	"rx_legacy_packets_per_sec",
+	"rx_legacy_bytes_per_sec",
+	"tx_stream_packets_per_sec",
+	"tx_stream_packets_lost_per_sec",
+	"tx_legacy_packets_per_sec",
+	"tx_legacy_bytes_per_sec",
+};
+
+enum {
+	RA_NET_TEST_REG_ID,
+	RA_NET_TEST_REG_MAC_ADDR,
+	RA_NET_TEST_PIO_READ_NS_PER_WORD,
+	RA_NET_TEST_PIO_READ_MBPS,
+	RA_NET_TEST_PIO_WRITE_NS_PER_WORD,
+	RA_NET_TEST_PIO_WRITE_MBPS,
+	RA_NET_TEST_MAX
+};
+
+static const char ra_net_gstrings_test[][ETH_GSTRING_LEN] = {
+	[RA_NET_TEST_REG_ID]			= "Register ID (online)",
+	[RA_NET_TEST_REG_MAC_ADDR]		= "Register r/w (offline)",
+	[RA_NET_TEST_PIO_READ_NS_PER_WORD]	= "PIO read ns/word (online)",
+	[RA_NET_TEST_PIO_READ_MBPS]		= "PIO read MB/s (online)",
+	[RA_NET_TEST_PIO_WRITE_NS_PER_WORD]	= "PIO write ns/word (offline)",
+	[RA_NET_TEST_PIO_WRITE_MBPS]		= "PIO write MB/s (offline)",
+};
+
+enum {
+	RA_NET_PRIV_FLAG_TX_ADAPTIVE_WAKE	= BIT(0),
+};
+
+static const char ra_net_gstrings_priv_flags[][ETH_GSTRING_LEN] = {
+	"tx-adaptive-wake",
 };
 
 struct ra_net_stats {
@@ -60,11 +100,17 @@ struct ra_net_stats {
 	u64 tx_broadcast_packets;
 	u64 tx_pad_packets;
 	u64 tx_oversize_packets;
+	u64 tx_queue_stops;
+
+	/* short window rate estimates, in the order of RA_NET_RATE_... */
+	u64 rates[RA_NET_RATE_MAX];
 };
 
 static void ra_net_read_stats(struct ra_net_priv *priv,
 			      struct ra_net_stats *stats)
 {
+	int i;
+
 	BUILD_BUG_ON(ARRAY_SIZE(ra_net_gstrings_stats) != sizeof(*stats) / sizeof(u64));
 
 	stats->udp_throttled_packets =
@@ -109,6 +155,11 @@ static void ra_net_read_stats(struct ra_net_priv *priv,
 		ra_net_ior(priv, RA_NET_TX_PAD_PKT_CNT);
 	stats->tx_oversize_packets =
 		ra_net_ior(priv, RA_NET_TX_OVERSIZE_PKT_CNT);
+	stats->tx_queue_stops = priv->tx_wake.stops;
+
+	ra_net_rates_read(priv, RA_NET_RATE_WINDOW_SHORT, stats->rates);
+	for (i = 0; i < RA_NET_RATE_MAX; i++)
+		stats->rates[i] = div_u64(stats->rates[i], RA_NET_RATE_SCALE);
 }
 
 static void ra_net_get_strings(struct net_device *netdev, u32 stringset, u8 *buf)
@@ -117,6 +168,13 @@ static void ra_net_get_strings(struct net_device *netdev, u32 stringset, u8 *buf
 	case ETH_SS_STATS:
 		memcpy(buf, &ra_net_gstrings_stats, sizeof(ra_net_gstrings_stats));
 		break;
+	case ETH_SS_PRIV_FLAGS:
+		memcpy(buf, &ra_net_gstrings_priv_flags,
+		       sizeof(ra_net_gstrings_priv_flags));
+		break;
+	case ETH_SS_TEST:
+		memcpy(buf, &ra_net_gstrings_test, sizeof(ra_net_gstrings_test));
+		break;
 	default:
 		WARN_ON(1);
 		break;
@@ -128,6 +186,10 @@ static int ra_net_get_sset_count(struct net_device *netdev, int sset)
 	switch (sset) {
 	case ETH_SS_STATS:
 		return ARRAY_SIZE(ra_net_gstrings_stats);
+	case ETH_SS_PRIV_FLAGS:
+		return ARRAY_SIZE(ra_net_gstrings_priv_flags);
+	case ETH_SS_TEST:
+		return ARRAY_SIZE(ra_net_gstrings_test);
 	default:
 		return -EINVAL;
 	}
@@ -193,6 +255,9 @@ static int ra_net_ethtool_get_ts_info(struct net_device *ndev,
 		BIT(HWTSTAMP_TX_ON);
 	info->rx_filters =
 		BIT(HWTSTAMP_FILTER_NONE) |
+		BIT(HWTSTAMP_FILTER_PTP_V2_EVENT) |
+		BIT(HWTSTAMP_FILTER_PTP_V2_SYNC) |
+		BIT(HWTSTAMP_FILTER_PTP_V2_DELAY_REQ) |
 		BIT(HWTSTAMP_FILTER_PTP_V2_L4_EVENT) |
 		BIT(HWTSTAMP_FILTER_PTP_V2_L4_SYNC) |
 		BIT(HWTSTAMP_FILTER_PTP_V2_L4_DELAY_REQ);
@@ -230,6 +295,272 @@ ra_net_ethtool_set_link_ksettings(struct net_device *ndev,
 	return phylink_ethtool_ksettings_set(priv->phylink, cmd);
 }
 
+/* Self test */
+
+#define RA_NET_TEST_RUNS		16
+#define RA_NET_TEST_READ_WORDS		256
+#define RA_NET_TEST_FRAME_LEN		ETH_FRAME_LEN
+#define RA_NET_TEST_FRAME_WORDS		\
+	(ALIGN(RA_NET_TEST_FRAME_LEN + RA_NET_TX_PADDING_BYTES, sizeof(u32)) / sizeof(u32))
+
+static void ra_net_test_report(struct ra_net_priv *priv, const char *what,
+			       u64 ns, unsigned int words,
+			       u64 *ns_per_word, u64 *mbps)
+{
+	u64 bytes = (u64)words * sizeof(u32);
+	u32 rem;
+
+	if (!ns)
+		ns = 1;
+
+	*ns_per_word = div_u64_rem(ns, words, &rem);
+	*mbps = div64_u64(bytes * NSEC_PER_SEC, ns * SZ_1M);
+
+	netdev_info(priv->ndev, "%s: %u words in %llu ns, %llu.%03llu ns/word, %llu MB/s\n",
+		    what, words, ns, *ns_per_word,
+		    div_u64((u64)rem * 1000, words), *mbps);
+}
+
+static bool ra_net_test_reg_id(struct ra_net_priv *priv)
+{
+	u32 val = ra_net_ior(priv, RA_NET_ID);
+
+	return val == RA_NET_ID_VALUE || val == RA_NET_ID_VALUE_2;
+}
+
+static bool ra_net_test_reg_mac_addr(struct ra_net_priv *priv)
+{
+	static const u32 patterns[] = { 0x00000000, 0xffffffff,
+					0x55555555, 0xaaaaaaaa };
+	u32 saved = ra_net_ior(priv, RA_NET_MAC_ADDR_L);
+	bool ok = true;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(patterns); i++) {
+		ra_net_iow(priv, RA_NET_MAC_ADDR_L, patterns[i]);
+		if (ra_net_ior(priv, RA_NET_MAC_ADDR_L) != patterns[i])
+			ok = false;
+	}
+
+	ra_net_iow(priv, RA_NET_MAC_ADDR_L, saved);
+
+	return ok;
+}
+
+/*
+ * Burst-read the ID register through ioread32_rep(). This exercises the
+ * same bus path as a read from RA_NET_RX_FIFO without consuming packets,
+ * and every word read must match the ID. The fastest of several runs is
+ * reported to filter out interrupts and other bus traffic.
+ */
+static bool ra_net_test_pio_read(struct ra_net_priv *priv, u64 *data)
+{
+	u64 best = U64_MAX;
+	bool ok = true;
+	u32 *buf;
+	int i, j;
+
+	buf = kmalloc_array(RA_NET_TEST_READ_WORDS, sizeof(u32), GFP_KERNEL);
+	if (!buf)
+		return false;
+
+	for (i = 0; i < RA_NET_TEST_RUNS; i++) {
+		u64 start, ns;
+
+		start = ktime_get_ns();
+		ioread32_rep(priv->regs + RA_NET_ID, buf, RA_NET_TEST_READ_WORDS);
+		ns = ktime_get_ns() - start;
+
+		best = min(best, ns);
+
+		for (j = 0; j < RA_NET_TEST_READ_WORDS; j++)
+			if (buf[j] != RA_NET_ID_VALUE && buf[j] != RA_NET_ID_VALUE_2)
+				ok = false;
+	}
+
+	kfree(buf);
+
+	ra_net_test_report(priv, "PIO read", best, RA_NET_TEST_READ_WORDS,
+			   &data[RA_NET_TEST_PIO_READ_NS_PER_WORD],
+			   &data[RA_NET_TEST_PIO_READ_MBPS]);
+
+	return ok;
+}
+
+/*
+ * Transmit full-sized frames through iowrite32_rep() into the TX FIFO and
+ * time the FIFO writes. The frames are addressed to the interface itself
+ * and carry the local experimental ethertype, so they are harmless on the
+ * wire.
+ */
+static bool ra_net_test_pio_write(struct ra_net_priv *priv, u64 *data)
+{
+	struct net_device *ndev = priv->ndev;
+	u64 best = U64_MAX;
+	bool ok = true;
+	struct ethhdr *eth;
+	u8 *buf;
+	int i;
+
+	if (!netif_running(ndev) || !netif_carrier_ok(ndev)) {
+		netdev_info(ndev, "PIO write: skipped, link is down\n");
+		return true;
+	}
+
+	buf = kzalloc(RA_NET_TEST_FRAME_WORDS * sizeof(u32), GFP_KERNEL);
+	if (!buf)
+		return false;
+
+	/* FPGA wants 2 bytes padding before data to insert packet length */
+	eth = (struct ethhdr *)(buf + RA_NET_TX_PADDING_BYTES);
+	ether_addr_copy(eth->h_dest, ndev->dev_addr);
+	ether_addr_copy(eth->h_source, ndev->dev_addr);
+	eth->h_proto = htons(ETH_P_802_EX1);
+
+	for (i = 0; i < RA_NET_TEST_RUNS; i++) {
+		u64 start, ns;
+		int ret;
+		u32 val;
+
+		ret = read_poll_timeout(ra_net_ior, val,
+					(val & RA_NET_TX_STATE_SPACE_AVAILABLE_MASK) >=
+						RA_NET_TEST_FRAME_WORDS * sizeof(u32),
+					10, USEC_PER_SEC / 10, false,
+					priv, RA_NET_TX_STATE);
+		if (ret < 0) {
+			netdev_err(ndev, "PIO write: timeout waiting for TX FIFO space\n");
+			ok = false;
+			break;
+		}
+
+		spin_lock_bh(&priv->lock);
+
+		start = ktime_get_ns();
+		ra_net_iow_rep(priv, RA_NET_TX_FIFO, buf,
+			       RA_NET_TEST_FRAME_WORDS * sizeof(u32));
+		ns = ktime_get_ns() - start;
+
+		ra_net_iow(priv, RA_NET_TX_CONFIG, RA_NET_TEST_FRAME_LEN);
+
+		/* dummy access needed by FPGA to have enough clock cycles */
+		ra_net_ior(priv, RA_NET_TX_STATE);
+
+		spin_unlock_bh(&priv->lock);
+
+		best = min(best, ns);
+	}
+
+	kfree(buf);
+
+	if (ok)
+		ra_net_test_report(priv, "PIO write", best, RA_NET_TEST_FRAME_WORDS,
+				   &data[RA_NET_TEST_PIO_WRITE_NS_PER_WORD],
+				   &data[RA_NET_TEST_PIO_WRITE_MBPS]);
+
+	return ok;
+}
+
+/*
+ * The register tests report 0 on success and 1 on failure. The benchmark
+ * entries report the measured values; they only flag the test as failed
+ * if the transfer itself went wrong.
+ */
+static void ra_net_ethtool_self_test(struct net_device *ndev,
+				     struct ethtool_test *test, u64 *data)
+{
+	struct ra_net_priv *priv = netdev_priv(ndev);
+	bool offline = test->flags & ETH_TEST_FL_OFFLINE;
+	bool running = netif_running(ndev);
+
+	memset(data, 0, sizeof(u64) * RA_NET_TEST_MAX);
+
+	if (!ra_net_test_reg_id(priv)) {
+		data[RA_NET_TEST_REG_ID] = 1;
+		test->flags |= ETH_TEST_FL_FAILED;
+	}
+
+	if (!ra_net_test_pio_read(priv, data))
+		test->flags |= ETH_TEST_FL_FAILED;
+
+	if (!offline)
+		return;
+
+	if (running)
+		netif_tx_disable(ndev);
+
+	if (!ra_net_test_reg_mac_addr(priv)) {
+		data[RA_NET_TEST_REG_MAC_ADDR] = 1;
+		test->flags |= ETH_TEST_FL_FAILED;
+	}
+
+	if (!ra_net_test_pio_write(priv, data))
+		test->flags |= ETH_TEST_FL_FAILED;
+
+	if (running)
+		netif_wake_queue(ndev);
+}
+
+/*
+ * The legacy interface has no descriptor rings. The TX "ring" reported
+ * here is the TX FIFO, in bytes, and the pending value is the amount of
+ * free FIFO space at which a stopped queue is woken again.
+ */
+static void
+ra_net_ethtool_get_ringparam(struct net_device *ndev,
+			     struct ethtool_ringparam *ring,
+			     struct kernel_ethtool_ringparam *kernel_ring,
+			     struct netlink_ext_ack *extack)
+{
+	struct ra_net_priv *priv = netdev_priv(ndev);
+
+	ring->tx_max_pending = priv->tx_wake.fifo_size;
+	ring->tx_pending = priv->tx_wake.threshold;
+}
+
+static int
+ra_net_ethtool_set_ringparam(struct net_device *ndev,
+			     struct ethtool_ringparam *ring,
+			     struct kernel_ethtool_ringparam *kernel_ring,
+			     struct netlink_ext_ack *extack)
+{
+	struct ra_net_priv *priv = netdev_priv(ndev);
+
+	if (ring->rx_pending || ring->rx_mini_pending || ring->rx_jumbo_pending)
+		return -EINVAL;
+
+	if (ring->tx_pending < RA_NET_TX_FIFO_MIN_SPACE_AVAILABLE ||
+	    ring->tx_pending > priv->tx_wake.fifo_size) {
+		NL_SET_ERR_MSG_MOD(extack, "TX wake threshold out of range");
+		return -EINVAL;
+	}
+
+	priv->tx_wake.threshold = ALIGN(ring->tx_pending, sizeof(u32));
+	WRITE_ONCE(priv->tx_wake.cur, priv->tx_wake.threshold);
+
+	return 0;
+}
+
+static u32 ra_net_ethtool_get_priv_flags(struct net_device *ndev)
+{
+	struct ra_net_priv *priv = netdev_priv(ndev);
+	u32 flags = 0;
+
+	if (priv->tx_wake.adaptive)
+		flags |= RA_NET_PRIV_FLAG_TX_ADAPTIVE_WAKE;
+
+	return flags;
+}
+
+static int ra_net_ethtool_set_priv_flags(struct net_device *ndev, u32 flags)
+{
+	struct ra_net_priv *priv = netdev_priv(ndev);
+
+	priv->tx_wake.adaptive = !!(flags & RA_NET_PRIV_FLAG_TX_ADAPTIVE_WAKE);
+	WRITE_ONCE(priv->tx_wake.cur, priv->tx_wake.threshold);
+
+	return 0;
+}
+
 const struct ethtool_ops ra_net_ethtool_ops = {
 	.get_drvinfo		= ra_net_ethtool_getdrvinfo,
 	.get_strings		= ra_net_get_strings,
@@ -245,4 +576,9 @@ const struct ethtool_ops ra_net_ethtool_ops = {
 	.get_module_eeprom	= ra_net_ethtool_get_module_eeprom,
 	.get_link_ksettings	= ra_net_ethtool_get_link_ksettings,
 	.set_link_ksettings	= ra_net_ethtool_set_link_ksettings,
+	.get_ringparam		= ra_net_ethtool_get_ringparam,
+	.set_ringparam		= ra_net_ethtool_set_ringparam,
+	.get_priv_flags		= ra_net_ethtool_get_priv_flags,
+	.set_priv_flags		= ra_net_ethtool_set_priv_flags,
+	.self_test		= ra_net_ethtool_self_test,
 };
@@ -13,49 +13,100 @@
 #include <linux/of_irq.h>
 #include <linux/of_platform.h>
 #include <linux/ptp_clock_kernel.h>
+#include <linux/rtnetlink.h>
 #include <linux/skbuff.h>
 #include <linux/spinlock.h>
 
 #include "main.h"
 
+#define CREATE_TRACE_POINTS
+#include "trace.h"
+
+static void ra_net_latency_poll(struct ra_net_priv *priv)
+{
+	u64 delay;
+
+	if (!priv->latency.irq_ns)
+		return;
+
+	delay = ktime_get_ns() - priv->latency.irq_ns;
+	priv->latency.irq_ns = 0;
+
+	ra_net_hist_add(&priv->latency.irq_to_poll, delay);
+	trace_ra_net_rx_irq_to_poll(priv->ndev, delay);
+}
+
+static void ra_net_rx_fifo_read(struct ra_net_priv *priv, void *buf, u32 len)
+{
+	u64 start, duration;
+
+	if (!ra_net_latency_enabled(priv)) {
+		ra_net_ior_rep(priv, RA_NET_RX_FIFO, buf, len);
+		return;
+	}
+
+	start = ktime_get_ns();
+	ra_net_ior_rep(priv, RA_NET_RX_FIFO, buf, len);
+	duration = ktime_get_ns() - start;
+
+	ra_net_hist_add(&priv->latency.fifo_read,
+			div_u64(duration, len / sizeof(u32)));
+	trace_ra_net_rx_fifo_read(priv->ndev, len, duration);
+}
+
 static int ra_net_napi_poll(struct napi_struct *napi, int budget)
 {
 	struct ra_net_priv *priv = container_of(napi, struct ra_net_priv, napi);
+	bool latency = ra_net_latency_enabled(priv);
 	int count;
 
+	if (latency)
+		ra_net_latency_poll(priv);
+
 	for (count = 0; count < budget; count++) {
+		struct ptp_packet_fpga_timestamp *ts = NULL;
 		struct sk_buff *skb;
 
 		u32 status = ra_net_ior(priv, RA_NET_RX_STATE);
 		u32 pkt_len = status & RA_NET_RX_STATE_PACKET_LEN_MASK;
 		u32 pkt_len_padded = ALIGN(pkt_len + RA_NET_RX_PADDING_BYTES,
 					   sizeof(u32));
+		u32 read_len = pkt_len_padded;
 
 		if (pkt_len == 0)
 			break;
 
 		dev_dbg(priv->dev, "%s() pkt_len %d\n", __func__, pkt_len);
 
-		skb = napi_alloc_skb(&priv->napi, pkt_len_padded+4);
+		/* The timestamp trails the packet, fetch both in one burst */
+		if (status & RA_NET_RX_STATE_PACKET_HAS_PTP_TS)
+			read_len += sizeof(*ts);
+
+		skb = napi_alloc_skb(&priv->napi, read_len+4);
 		if (unlikely(!skb)) {
 			priv->ndev->stats.rx_fifo_errors++;
 			break;
 		}
 
-		ra_net_ior_rep(priv, RA_NET_RX_FIFO, skb->data,	pkt_len_padded);
+		ra_net_rx_fifo_read(priv, skb->data, read_len);
+
+		if (status & RA_NET_RX_STATE_PACKET_HAS_PTP_TS)
+			ts = (struct ptp_packet_fpga_timestamp *)
+				(skb->data + pkt_len_padded);
 
 		/* FPGA inserts 2 padding bytes */
 		skb_reserve(skb, RA_NET_RX_PADDING_BYTES);
 		skb_put(skb, pkt_len);
 
+		/* The timestamp stays in the tailroom until it is applied */
+		if (ts)
+			ra_net_rx_apply_timestamp(priv, skb, ts);
+
 		skb->protocol = eth_type_trans(skb, priv->ndev);
 
 		/* FPGA does IP checksum offload for receive packets */
 		skb->ip_summed = CHECKSUM_UNNECESSARY;
 
-		if (status & RA_NET_RX_STATE_PACKET_HAS_PTP_TS)
-			ra_net_rx_read_timestamp(priv, skb);
-
 		priv->ndev->stats.rx_packets++;
 		priv->ndev->stats.rx_bytes += pkt_len;
 
@@ -64,11 +115,15 @@ static int ra_net_napi_poll(struct napi_struct *napi, int budget)
 		napi_gro_receive(&priv->napi, skb);
 	}
 
+	if (latency) {
+		ra_net_hist_add(&priv->latency.napi_batch, count);
+		trace_ra_net_rx_napi_batch(priv->ndev, count, budget);
+	}
+
 	if (count < budget)
 		napi_complete_done(&priv->napi, count);
 
-	if (netif_queue_stopped(priv->ndev))
-		netif_wake_queue(priv->ndev);
+	ra_net_tx_maybe_wake(priv);
 
 	ra_net_irq_enable(priv, RA_NET_IRQ_RX_PACKET_AVAILABLE);
 
@@ -106,10 +161,10 @@ static irqreturn_t ra_net_irqhandler(int irq, void *dev_id)
 	if (irqs & RA_NET_IRQ_RX_PACKET_AVAILABLE) {
 		ra_net_irq_disable(priv, RA_NET_IRQ_RX_PACKET_AVAILABLE);
 
-		if (priv->dma_rx_chan)
-			ra_net_dma_rx(priv);
-		else
-			napi_schedule(&priv->napi);
+		if (ra_net_latency_enabled(priv))
+			priv->latency.irq_ns = ktime_get_ns();
+
+		napi_schedule(&priv->napi);
 	}
 
 	if (irqs & RA_NET_IRQ_TX_SPACE_AVAILABLE) {
@@ -345,6 +400,44 @@ out:
 	return ret;
 }
 
+static u32 ra_net_tx_wake_threshold(struct ra_net_priv *priv)
+{
+	struct ra_net_tx_wake *w = &priv->tx_wake;
+	unsigned long now = jiffies;
+	u32 max;
+
+	w->stops++;
+
+	if (!w->adaptive) {
+		w->cur = w->threshold;
+		return w->cur;
+	}
+
+	/* Never wait for more than 3/4 of the FIFO to drain */
+	max = max(w->threshold, ALIGN_DOWN(w->fifo_size * 3 / 4, sizeof(u32)));
+
+	if (time_before(now, w->last_stop + RA_NET_TX_WAKE_BURST_JIFFIES))
+		w->cur = min(w->cur * 2, max);
+	else
+		w->cur = w->threshold;
+
+	w->last_stop = now;
+
+	return w->cur;
+}
+
+void ra_net_tx_maybe_wake(struct ra_net_priv *priv)
+{
+	u32 free;
+
+	if (!netif_queue_stopped(priv->ndev))
+		return;
+
+	free = ra_net_ior(priv, RA_NET_TX_STATE) & RA_NET_TX_STATE_SPACE_AVAILABLE_MASK;
+	if (free >= READ_ONCE(priv->tx_wake.cur))
+		netif_wake_queue(priv->ndev);
+}
+
 static netdev_tx_t ra_net_start_xmit(struct sk_buff *skb, struct net_device *ndev)
 {
 	struct ra_net_priv *priv = netdev_priv(ndev);
@@ -354,12 +447,12 @@ static netdev_tx_t ra_net_start_xmit(struct sk_buff *skb, struct net_device *nde
 
 	ret = ra_net_hw_xmit_skb(skb, ndev);
 	if (unlikely(ret == -ENOSPC)) {
-		net_warn_ratelimited("%s: No space in TX FIFO.", ndev->name);
+		net_dbg_ratelimited("%s: No space in TX FIFO.", ndev->name);
 
 		netif_stop_queue(ndev);
 
 		ra_net_iow(priv, RA_NET_TX_FIFO_SPACE_AV_BYTECNT,
-			   RA_NET_TX_FIFO_MIN_SPACE_AVAILABLE);
+			   ra_net_tx_wake_threshold(priv));
 		ra_net_irq_enable(priv, RA_NET_IRQ_TX_SPACE_AVAILABLE);
 
 		return NETDEV_TX_BUSY;
@@ -368,15 +461,52 @@ static netdev_tx_t ra_net_start_xmit(struct sk_buff *skb, struct net_device *nde
 	return NETDEV_TX_OK;
 }
 
-static void ra_net_tx_timeout(struct net_device *ndev, unsigned int txqueue)
+/*
+ * The TX watchdog runs in softirq context, but quiescing NAPI and the
+ * DMA engine before the reset may sleep, so the reset is done here.
+ */
+static void ra_net_reset_work(struct work_struct *work)
 {
-	struct ra_net_priv *priv = netdev_priv(ndev);
+	struct ra_net_priv *priv =
+		container_of(work, struct ra_net_priv, reset_work);
+	struct net_device *ndev = priv->ndev;
 
-	dev_warn(priv->dev, "timeout! txqueue = %d\n", txqueue);
+	rtnl_lock();
+
+	if (!netif_running(ndev))
+		goto out_unlock;
+
+	netif_tx_disable(ndev);
+	napi_disable(&priv->napi);
 
 	ra_net_reset(priv);
+
+	napi_enable(&priv->napi);
+
+	ra_net_irq_enable(priv, RA_NET_IRQ_RX_PACKET_AVAILABLE |
+				RA_NET_IRQ_RX_OVERRUN);
+
 	netif_trans_update(ndev);
 	netif_wake_queue(ndev);
+
+out_unlock:
+	rtnl_unlock();
+}
+
+static void ra_net_cancel_reset_work(void *data)
+{
+	struct ra_net_priv *priv = data;
+
+	cancel_work_sync(&priv->reset_work);
+}
+
+static void ra_net_tx_timeout(struct net_device *ndev, unsigned int txqueue)
+{
+	struct ra_net_priv *priv = netdev_priv(ndev);
+
+	dev_warn(priv->dev, "timeout! txqueue = %d\n", txqueue);
+
+	schedule_work(&priv->reset_work);
 }
 
 static void ra_net_set_rx_mode(struct net_device *ndev)
@@ -529,7 +659,8 @@ static int ra_net_drv_probe(struct platform_device *pdev)
 
 	spin_lock_init(&priv->lock);
 	spin_lock_init(&priv->reg_lock);
-	spin_lock_init(&priv->mdio_lock);
+	mutex_init(&priv->mdio_lock);
+	INIT_WORK(&priv->reset_work, ra_net_reset_work);
 
 	res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
 	priv->regs = devm_ioremap_resource(dev, res);
@@ -576,6 +707,15 @@ static int ra_net_drv_probe(struct platform_device *pdev)
 
 	ra_net_tx_ts_init(priv);
 
+	/* The TX FIFO is empty at this point, so the free space is its size */
+	val = ra_net_ior(priv, RA_NET_TX_STATE) & RA_NET_TX_STATE_SPACE_AVAILABLE_MASK;
+	if (val < RA_NET_TX_FIFO_MIN_SPACE_AVAILABLE)
+		val = RA_NET_TX_STATE_SPACE_AVAILABLE_MASK;
+
+	priv->tx_wake.fifo_size = val;
+	priv->tx_wake.threshold = RA_NET_TX_FIFO_MIN_SPACE_AVAILABLE;
+	priv->tx_wake.cur = RA_NET_TX_FIFO_MIN_SPACE_AVAILABLE;
+
 	ndev->irq = irq;
 	ndev->netdev_ops = &ra_net_netdev_ops;
 	ndev->min_mtu = 68;
@@ -585,7 +725,6 @@ static int ra_net_drv_probe(struct platform_device *pdev)
 
 	strcpy(ndev->name, "ra%d");
 	SET_NETDEV_DEV(ndev, dev);
-	netif_napi_add(ndev, &priv->napi, ra_net_napi_poll);
 
 	if (!is_valid_ether_addr(ndev->dev_addr))
 		eth_hw_addr_random(ndev);
@@ -612,31 +751,18 @@ static int ra_net_drv_probe(struct platform_device *pdev)
 		return ret;
 	}
 
-	tmp = 0;
-	of_property_read_u32(node, "lawo,ptp-delay-path-rx-1000mbit-nsec", &tmp);
-	val = tmp & 0xffff;
+	netif_napi_add(ndev, &priv->napi,
+		       priv->dma_rx_chan ? ra_net_dma_napi_poll : ra_net_napi_poll);
 
-	tmp = 0;
-	of_property_read_u32(node, "lawo,ptp-delay-path-rx-100mbit-nsec", &tmp);
-	val |= tmp << 16;
+	ra_net_ptp_delay_init(priv);
 
-	if (val != 0) {
-		dev_dbg(dev, "RA_NET_PTP_DELAY_ADJUST_1 = 0x%08x\n", val);
-		ra_net_iow(priv, RA_NET_PTP_DELAY_ADJUST_1, val);
-	}
-
-	tmp = 0;
-	of_property_read_u32(node, "lawo,ptp-delay-path-rx-10mbit-nsec", &tmp);
-	val = tmp & 0xffff;
-
-	tmp = 0;
-	of_property_read_u32(node, "lawo,ptp-delay-path-tx-nsec", &tmp);
-	val |= tmp << 16;
+	ret = ra_net_rtp_slew_init(priv);
+	if (ret < 0)
+		return ret;
 
-	if (val != 0) {
-		dev_dbg(dev, "RA_NET_PTP_DELAY_ADJUST_2 = 0x%08x\n", val);
-		ra_net_iow(priv, RA_NET_PTP_DELAY_ADJUST_2, val);
-	}
+	ret = ra_net_counters_init(priv);
+	if (ret < 0)
+		return ret;
 
 	tmp = 5000;
 	of_property_read_u32(node, "lawo,watchdog-timeout-ms", &tmp);
@@ -644,12 +770,20 @@ static int ra_net_drv_probe(struct platform_device *pdev)
 
 	priv->rx_dropped_packets_at_probe = ra_net_ior(priv, RA_NET_RX_PACKET_DROPPED_CNT);
 
+	ret = devm_add_action_or_reset(dev, ra_net_cancel_reset_work, priv);
+	if (ret < 0)
+		return ret;
+
 	ret = devm_register_netdev(dev, ndev);
 	if (ret < 0) {
 		dev_err(dev, "could not register network device: %d\n", ret);
 		return ret;
 	}
 
+	ret = ra_net_debugfs_init(priv);
+	if (ret < 0)
+		return ret;
+
 	val = ra_net_ior(priv, RA_NET_RAV_CORE_VERSION);
 
 	dev_info(dev, "Ravenna ethernet driver, core version: %02x.%02x, %s mode\n",
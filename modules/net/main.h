@@ -1,17 +1,26 @@
 #ifndef RAVENNA_NET_MAIN_H
 #define RAVENNA_NET_MAIN_H
 
+#include <linux/mutex.h>
 #include <linux/of_platform.h>
 #include <linux/workqueue.h>
 #include <linux/phylink.h>
 #include <linux/ptp_classify.h>
 #include <linux/dmaengine.h>
+#include <linux/hrtimer.h>
+#include <linux/jump_label.h>
+#include <linux/log2.h>
+
+#include <uapi/ravenna/net.h>
 
 #include "regs.h"
 
 #define RA_NET_TX_SKB_LIST_SIZE	64
 #define RA_NET_TX_TS_LIST_SIZE	64
 
+/* Queue stops closer together than this count as sustained TX load */
+#define RA_NET_TX_WAKE_BURST_JIFFIES	msecs_to_jiffies(10)
+
 /* raw timestamp data read from FPGA */
 struct ptp_packet_fpga_timestamp
 {
@@ -44,16 +53,172 @@ struct ra_net_tx_ts {
 	unsigned int ts_wr_idx;
 };
 
+/*
+ * The TX queue is stopped when the FIFO is full and woken by the
+ * RA_NET_IRQ_TX_SPACE_AVAILABLE interrupt once 'cur' bytes are free again.
+ * In adaptive mode, 'cur' is doubled each time the queue stops again
+ * shortly after it was woken, so each wakeup drains a larger batch under
+ * sustained load. It falls back to 'threshold' once the load subsides.
+ */
+struct ra_net_tx_wake {
+	bool adaptive;
+	u32 threshold;
+	u32 cur;
+	u32 fifo_size;
+	unsigned long last_stop;
+	u64 stops;
+};
+
+/*
+ * Slewed update of RA_NET_RTP_GLOBAL_OFFSET. The hrtimer moves 'offset'
+ * towards 'target' by at most 'rate' samples per second. 'acc' carries
+ * the fractional samples between timer ticks, in units of samples * ns.
+ */
+#define RA_NET_RTP_SLEW_INTERVAL_NS	(NSEC_PER_SEC / 1000)
+
+struct ra_net_rtp_slew {
+	spinlock_t lock;
+	struct hrtimer timer;
+	bool active;
+	u32 rate;
+	u32 offset;
+	u32 target;
+	u64 acc;
+};
+
+/*
+ * PTP timestamp path delay compensation, in ns, per link speed. The RX
+ * values of all speeds have their own register fields, but there is
+ * only one TX field, so it is reprogrammed with the value for the new
+ * speed on every link up. 'suggest' holds the result of the last
+ * calibration calculation.
+ */
+enum {
+	RA_NET_PTP_DELAY_10MBIT,
+	RA_NET_PTP_DELAY_100MBIT,
+	RA_NET_PTP_DELAY_1000MBIT,
+	RA_NET_PTP_DELAY_SPEEDS
+};
+
+struct ra_net_ptp_delay {
+	struct mutex lock;
+	u16 rx[RA_NET_PTP_DELAY_SPEEDS];
+	u16 tx[RA_NET_PTP_DELAY_SPEEDS];
+	int speed;
+
+	struct {
+		bool valid;
+		int speed;
+		u16 rx;
+		u16 tx;
+	} suggest;
+};
+
+/*
+ * Traffic classes for which rates are estimated. Stream traffic is
+ * handled by the FPGA and only counted in packets; legacy traffic goes
+ * through the driver, so its bytes are known as well.
+ */
+enum {
+	RA_NET_RATE_RX_STREAM_PACKETS,
+	RA_NET_RATE_RX_LEGACY_PACKETS,
+	RA_NET_RATE_RX_LEGACY_BYTES,
+	RA_NET_RATE_TX_STREAM_PACKETS,
+	RA_NET_RATE_TX_STREAM_PACKETS_LOST,
+	RA_NET_RATE_TX_LEGACY_PACKETS,
+	RA_NET_RATE_TX_LEGACY_BYTES,
+	RA_NET_RATE_MAX
+};
+
+enum {
+	RA_NET_RATE_WINDOW_SHORT,
+	RA_NET_RATE_WINDOW_LONG,
+	RA_NET_RATE_WINDOWS
+};
+
+#define RA_NET_RATE_WINDOW_SHORT_MS	5000
+#define RA_NET_RATE_WINDOW_LONG_MS	60000
+
+/* Rates are kept in units per second, scaled by RA_NET_RATE_SCALE */
+#define RA_NET_RATE_SCALE		1000
+
+struct ra_net_rates {
+	u32 window_ms[RA_NET_RATE_WINDOWS];
+	u64 last_ns;
+	u64 last[RA_NET_RATE_MAX];
+	u64 rate[RA_NET_RATE_WINDOWS][RA_NET_RATE_MAX];
+};
+
+/* 64-bit accumulators for the hardware counters, see counters.c */
+struct ra_net_counters_acc {
+	struct mutex mutex;
+	struct delayed_work work;
+	u32 last[RA_NET_COUNTER_MAX];
+	u64 acc[RA_NET_COUNTER_MAX];
+
+	struct ra_net_rates rates;
+};
+
+/*
+ * Optional RX latency instrumentation. Bucket 0 counts zero values,
+ * bucket n counts values in [2^(n-1), 2^n).
+ */
+#define RA_NET_HIST_BUCKETS	32
+
+struct ra_net_hist {
+	u64 buckets[RA_NET_HIST_BUCKETS];
+};
+
+struct ra_net_latency {
+	bool enable;
+	u64 irq_ns;
+
+	struct ra_net_hist irq_to_poll;	/* ns */
+	struct ra_net_hist fifo_read;	/* ns per 32-bit word */
+	struct ra_net_hist napi_batch;	/* packets */
+};
+
+DECLARE_STATIC_KEY_FALSE(ra_net_latency_key);
+
+/*
+ * DMA RX ring with free running indices: the buffers in [clean, done)
+ * hold received packets waiting for NAPI, [done, fill) are in flight,
+ * and [fill, refill) are mapped and ready for the next transfer.
+ */
+#define RA_NET_DMA_RX_RING_SIZE	32
+#define RA_NET_DMA_RX_BUF_LEN	\
+	ALIGN(RA_NET_RX_STATE_PACKET_LEN_MASK + RA_NET_RX_PADDING_BYTES + \
+	      sizeof(struct ptp_packet_fpga_timestamp), SMP_CACHE_BYTES)
+
+struct ra_net_dma_rx_buf {
+	struct sk_buff *skb;
+	dma_addr_t dma_addr;
+	u32 len;
+	bool timestamped;
+};
+
+struct ra_net_dma_rx {
+	spinlock_t lock;
+	struct ra_net_dma_rx_buf ring[RA_NET_DMA_RX_RING_SIZE];
+	unsigned int clean;
+	unsigned int done;
+	unsigned int fill;
+	unsigned int refill;
+};
+
 struct ra_net_priv {
 	void __iomem *regs;
 
 	spinlock_t lock;
 	spinlock_t reg_lock;
-	spinlock_t mdio_lock;
+
+	struct mutex mdio_lock;
+	bool mdio_idle;
 
 	struct device	 	*dev;
 	struct net_device 	*ndev;
 	struct napi_struct	napi;
+	struct work_struct	reset_work;
 
 	struct phylink		*phylink;
 	struct phylink_config	phylink_config;
@@ -61,10 +226,22 @@ struct ra_net_priv {
 	struct dma_chan		*dma_rx_chan;
 	dma_addr_t		dma_addr;
 
+	struct ra_net_dma_rx	dma_rx;
+
 	int phc_index;
 
 	struct ra_net_tx_ts tx_ts;
 	bool rx_ts_enable;
+	bool rx_ts_l2;
+	u16 rx_ts_msg_types;
+	struct ra_net_ptp_delay ptp_delay;
+
+	struct ra_net_tx_wake tx_wake;
+	struct ra_net_rtp_slew rtp_slew;
+	struct ra_net_counters_acc counters;
+
+	struct dentry *debugfs;
+	struct ra_net_latency latency;
 
 	int rx_dropped_packets_at_probe;
 };
@@ -126,9 +303,27 @@ static inline void ra_net_pp_irq_disable(struct ra_net_priv *priv, u32 bit)
 	ra_net_iow_mask(priv, RA_NET_PP_IRQ_DISABLE, bit, bit);
 }
 
+static inline bool ra_net_latency_enabled(struct ra_net_priv *priv)
+{
+	return static_branch_unlikely(&ra_net_latency_key) &&
+	       READ_ONCE(priv->latency.enable);
+}
+
+static inline void ra_net_hist_add(struct ra_net_hist *h, u64 v)
+{
+	unsigned int i = 0;
+
+	if (v)
+		i = min_t(unsigned int, ilog2(v) + 1, RA_NET_HIST_BUCKETS - 1);
+
+	h->buckets[i]++;
+}
+
 extern const struct ethtool_ops ra_net_ethtool_ops;
 extern const struct attribute_group ra_net_attr_group;
 
+void ra_net_tx_maybe_wake(struct ra_net_priv *priv);
+
 int ra_net_phylink_init(struct ra_net_priv *priv);
 int ra_net_mdio_init(struct ra_net_priv *priv);
 
@@ -138,12 +333,28 @@ bool ra_net_tx_ts_queue(struct ra_net_priv *priv, struct sk_buff *skb);
 void ra_net_tx_ts_init(struct ra_net_priv *priv);
 int ra_net_hwtstamp_ioctl(struct net_device *ndev,
 			  struct ifreq *ifr, int cmd);
-void ra_net_rx_read_timestamp(struct ra_net_priv *priv, struct sk_buff *skb);
 void ra_net_rx_apply_timestamp(struct ra_net_priv *priv, struct sk_buff *skb,
-			       struct ptp_packet_fpga_timestamp *ts);
+			       const struct ptp_packet_fpga_timestamp *ts);
+void ra_net_ptp_delay_init(struct ra_net_priv *priv);
+int ra_net_ptp_delay_index(int speed);
+void ra_net_ptp_delay_apply(struct ra_net_priv *priv, int speed);
+int ra_net_ptp_delay_set(struct ra_net_priv *priv, int idx,
+			 bool tx, u32 ns);
+int ra_net_ptp_delay_calibrate(struct ra_net_priv *priv,
+			       s32 time_error_ns, s32 path_delay_error_ns);
+
+int ra_net_debugfs_init(struct ra_net_priv *priv);
+int ra_net_rtp_slew_init(struct ra_net_priv *priv);
+
+int ra_net_counters_init(struct ra_net_priv *priv);
+void ra_net_counters_snapshot(struct ra_net_priv *priv,
+			      struct ra_net_counters *snap);
+void ra_net_counters_reset_hw(struct ra_net_priv *priv, u32 mask);
+void ra_net_rates_read(struct ra_net_priv *priv, unsigned int window,
+		       u64 *rates);
 
 int ra_net_dma_probe(struct ra_net_priv *priv);
 void ra_net_dma_flush(struct ra_net_priv *priv);
-void ra_net_dma_rx(struct ra_net_priv *priv);
+int ra_net_dma_napi_poll(struct napi_struct *napi, int budget);
 
 #endif /* RAVENNA_NET_MAIN_H */
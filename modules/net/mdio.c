@@ -10,14 +10,31 @@
 
 #define RA_NET_MDIO_BUSY_TIMEOUT USEC_PER_SEC
 
+/*
+ * A clause 22 frame is 64 bits long, which takes about 26 us at the usual
+ * MDC rate of 2.5 MHz. Sleep in steps of that order rather than spinning.
+ */
+#define RA_NET_MDIO_POLL_US	20
+
 static inline int ra_net_mdio_wait_ready(struct ra_net_priv *priv)
 {
 	u32 val;
+	int ret;
+
+	ret = read_poll_timeout(ra_net_ior, val,
+				!(val & RA_NET_MDIO_CTRL_BUSY),
+				RA_NET_MDIO_POLL_US, RA_NET_MDIO_BUSY_TIMEOUT,
+				true, priv, RA_NET_MDIO_CTRL);
 
-	return read_poll_timeout(ra_net_ior, val,
-				 !(val & RA_NET_MDIO_CTRL_BUSY),
-				 1000, RA_NET_MDIO_BUSY_TIMEOUT, false,
-				 priv, RA_NET_MDIO_CTRL);
+	/*
+	 * Remember whether the bus is known to be idle. Every transaction
+	 * waits for its own completion, so back-to-back accesses (such as
+	 * the register sequences phylink issues when polling the PHY) can
+	 * skip the leading busy poll.
+	 */
+	priv->mdio_idle = (ret == 0);
+
+	return ret;
 }
 
 static inline void ra_net_mdio_write_ctrl(struct ra_net_priv *priv,
@@ -32,27 +49,29 @@ static inline void ra_net_mdio_write_ctrl(struct ra_net_priv *priv,
 	if (write)
 		val |= RA_NET_MDIO_CTRL_WRITE;
 
+	priv->mdio_idle = false;
 	ra_net_iow(priv, RA_NET_MDIO_CTRL, val);
 }
 
 static int ra_net_mdio_read(struct mii_bus *mii, int phy_id, int regnum)
 {
 	struct ra_net_priv *priv = mii->priv;
-	int ret;
+	int ret = 0;
 
-	ret = ra_net_mdio_wait_ready(priv);
-	if (ret < 0)
-		return ret;
+	mutex_lock(&priv->mdio_lock);
 
-	spin_lock(&priv->mdio_lock);
+	if (!priv->mdio_idle)
+		ret = ra_net_mdio_wait_ready(priv);
 
-	ra_net_mdio_write_ctrl(priv, phy_id, regnum, false);
+	if (ret == 0) {
+		ra_net_mdio_write_ctrl(priv, phy_id, regnum, false);
 
-	ret = ra_net_mdio_wait_ready(priv);
-	if (ret == 0)
-		ret = ra_net_ior(priv, RA_NET_MDIO_DATA);
+		ret = ra_net_mdio_wait_ready(priv);
+		if (ret == 0)
+			ret = ra_net_ior(priv, RA_NET_MDIO_DATA) & 0xffff;
+	}
 
-	spin_unlock(&priv->mdio_lock);
+	mutex_unlock(&priv->mdio_lock);
 
 	return ret;
 }
@@ -61,20 +80,21 @@ static int ra_net_mdio_write(struct mii_bus *mii, int phy_id,
 			     int regnum, u16 data)
 {
 	struct ra_net_priv *priv = mii->priv;
-	int ret;
+	int ret = 0;
 
-	ret = ra_net_mdio_wait_ready(priv);
-	if (ret < 0)
-		return ret;
+	mutex_lock(&priv->mdio_lock);
 
-	spin_lock(&priv->mdio_lock);
+	if (!priv->mdio_idle)
+		ret = ra_net_mdio_wait_ready(priv);
 
-	ra_net_iow(priv, RA_NET_MDIO_DATA, data);
-	ra_net_mdio_write_ctrl(priv, phy_id, regnum, true);
+	if (ret == 0) {
+		ra_net_iow(priv, RA_NET_MDIO_DATA, data);
+		ra_net_mdio_write_ctrl(priv, phy_id, regnum, true);
 
-	ret = ra_net_mdio_wait_ready(priv);
+		ret = ra_net_mdio_wait_ready(priv);
+	}
 
-	spin_unlock(&priv->mdio_lock);
+	mutex_unlock(&priv->mdio_lock);
 
 	return ret;
 }
@@ -51,6 +51,7 @@ static void ra_net_mac_link_up(struct phylink_config *config,
 	}
 
 	ra_net_iow(priv, RA_NET_AUTO_SPEED_CTRL, v);
+	ra_net_ptp_delay_apply(priv, speed);
 }
 
 static const struct phylink_mac_ops ra_net_phylink_ops = {
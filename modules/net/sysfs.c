@@ -23,6 +23,78 @@ static ssize_t rav_core_version_show(struct device *dev,
 }
 static DEVICE_ATTR_RO(rav_core_version);
 
+/* RTP global offset */
+
+static enum hrtimer_restart ra_net_rtp_slew_timer(struct hrtimer *timer)
+{
+	struct ra_net_priv *priv =
+		container_of(timer, struct ra_net_priv, rtp_slew.timer);
+	struct ra_net_rtp_slew *slew = &priv->rtp_slew;
+	enum hrtimer_restart ret = HRTIMER_RESTART;
+	unsigned long flags;
+	s32 remaining;
+	u32 step;
+
+	spin_lock_irqsave(&slew->lock, flags);
+
+	if (!slew->active) {
+		ret = HRTIMER_NORESTART;
+		goto out_unlock;
+	}
+
+	slew->acc += (u64)slew->rate * RA_NET_RTP_SLEW_INTERVAL_NS;
+	step = div_u64(slew->acc, NSEC_PER_SEC);
+	if (!step)
+		goto out_forward;
+
+	slew->acc -= (u64)step * NSEC_PER_SEC;
+
+	/* The offset wraps, so take the shortest way to the target */
+	remaining = (s32)(slew->target - slew->offset);
+
+	if (abs(remaining) <= step) {
+		slew->offset = slew->target;
+		slew->active = false;
+		ret = HRTIMER_NORESTART;
+	} else if (remaining > 0) {
+		slew->offset += step;
+	} else {
+		slew->offset -= step;
+	}
+
+	ra_net_iow(priv, RA_NET_RTP_GLOBAL_OFFSET, slew->offset);
+
+out_forward:
+	if (ret == HRTIMER_RESTART)
+		hrtimer_forward_now(timer, ns_to_ktime(RA_NET_RTP_SLEW_INTERVAL_NS));
+
+out_unlock:
+	spin_unlock_irqrestore(&slew->lock, flags);
+
+	return ret;
+}
+
+static void ra_net_rtp_slew_cancel(void *data)
+{
+	struct ra_net_priv *priv = data;
+
+	hrtimer_cancel(&priv->rtp_slew.timer);
+}
+
+int ra_net_rtp_slew_init(struct ra_net_priv *priv)
+{
+	struct ra_net_rtp_slew *slew = &priv->rtp_slew;
+
+	spin_lock_init(&slew->lock);
+	hrtimer_init(&slew->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	slew->timer.function = ra_net_rtp_slew_timer;
+
+	slew->offset = ra_net_ior(priv, RA_NET_RTP_GLOBAL_OFFSET);
+	slew->target = slew->offset;
+
+	return devm_add_action_or_reset(priv->dev, ra_net_rtp_slew_cancel, priv);
+}
+
 static ssize_t rtp_global_offset_show(struct device *dev,
 				      struct device_attribute *attr,
 				      char *buf)
@@ -38,6 +110,8 @@ static ssize_t rtp_global_offset_store(struct device *dev,
 				       const char *buf, size_t count)
 {
 	struct ra_net_priv *priv = netdev_priv(to_net_dev(dev));
+	struct ra_net_rtp_slew *slew = &priv->rtp_slew;
+	unsigned long flags;
 	int ret;
 	u32 v;
 
@@ -45,12 +119,129 @@ static ssize_t rtp_global_offset_store(struct device *dev,
 	if (ret < 0)
 		return ret;
 
+	/* A direct write steps the offset and aborts any ongoing slew */
+	spin_lock_irqsave(&slew->lock, flags);
+	slew->active = false;
+	slew->offset = v;
+	slew->target = v;
 	ra_net_iow(priv, RA_NET_RTP_GLOBAL_OFFSET, v);
+	spin_unlock_irqrestore(&slew->lock, flags);
 
 	return count;
 }
 static DEVICE_ATTR_RW(rtp_global_offset);
 
+static ssize_t rtp_global_offset_target_show(struct device *dev,
+					     struct device_attribute *attr,
+					     char *buf)
+{
+	struct ra_net_priv *priv = netdev_priv(to_net_dev(dev));
+
+	return sysfs_emit(buf, "%u\n", READ_ONCE(priv->rtp_slew.target));
+}
+
+static ssize_t rtp_global_offset_target_store(struct device *dev,
+					      struct device_attribute *attr,
+					      const char *buf, size_t count)
+{
+	struct ra_net_priv *priv = netdev_priv(to_net_dev(dev));
+	struct ra_net_rtp_slew *slew = &priv->rtp_slew;
+	unsigned long flags;
+	bool start = false;
+	int ret;
+	u32 v;
+
+	ret = kstrtou32(buf, 0, &v);
+	if (ret < 0)
+		return ret;
+
+	spin_lock_irqsave(&slew->lock, flags);
+
+	slew->target = v;
+
+	if (slew->rate == 0 || slew->offset == v) {
+		/* Slewing disabled, step to the target */
+		slew->active = false;
+		slew->offset = v;
+		ra_net_iow(priv, RA_NET_RTP_GLOBAL_OFFSET, v);
+	} else if (!slew->active) {
+		slew->active = true;
+		slew->acc = 0;
+		start = true;
+	}
+
+	spin_unlock_irqrestore(&slew->lock, flags);
+
+	if (start)
+		hrtimer_start(&slew->timer, ns_to_ktime(RA_NET_RTP_SLEW_INTERVAL_NS),
+			      HRTIMER_MODE_REL);
+
+	return count;
+}
+static DEVICE_ATTR_RW(rtp_global_offset_target);
+
+static ssize_t rtp_global_offset_slew_rate_show(struct device *dev,
+						struct device_attribute *attr,
+						char *buf)
+{
+	struct ra_net_priv *priv = netdev_priv(to_net_dev(dev));
+
+	return sysfs_emit(buf, "%u\n", READ_ONCE(priv->rtp_slew.rate));
+}
+
+static ssize_t rtp_global_offset_slew_rate_store(struct device *dev,
+						 struct device_attribute *attr,
+						 const char *buf, size_t count)
+{
+	struct ra_net_priv *priv = netdev_priv(to_net_dev(dev));
+	struct ra_net_rtp_slew *slew = &priv->rtp_slew;
+	unsigned long flags;
+	int ret;
+	u32 v;
+
+	ret = kstrtou32(buf, 0, &v);
+	if (ret < 0)
+		return ret;
+
+	spin_lock_irqsave(&slew->lock, flags);
+
+	slew->rate = v;
+
+	/* Slewing disabled, step an ongoing slew to its target */
+	if (v == 0 && slew->active) {
+		slew->active = false;
+		slew->offset = slew->target;
+		ra_net_iow(priv, RA_NET_RTP_GLOBAL_OFFSET, slew->target);
+	}
+
+	spin_unlock_irqrestore(&slew->lock, flags);
+
+	return count;
+}
+static DEVICE_ATTR_RW(rtp_global_offset_slew_rate);
+
+static ssize_t rtp_global_offset_slew_status_show(struct device *dev,
+						  struct device_attribute *attr,
+						  char *buf)
+{
+	struct ra_net_priv *priv = netdev_priv(to_net_dev(dev));
+	struct ra_net_rtp_slew *slew = &priv->rtp_slew;
+	u32 offset, target;
+	unsigned long flags;
+	bool active;
+
+	spin_lock_irqsave(&slew->lock, flags);
+	active = slew->active;
+	offset = slew->offset;
+	target = slew->target;
+	spin_unlock_irqrestore(&slew->lock, flags);
+
+	return sysfs_emit(buf, "%s %u %u %d\n",
+			  active ? "slewing" : "idle",
+			  offset, target, (s32)(target - offset));
+}
+static DEVICE_ATTR_RO(rtp_global_offset_slew_status);
+
 static ssize_t counter_reset_store(struct device *dev,
 				   struct device_attribute *attr,
 				   const char *buf, size_t count)
@@ -63,7 +254,7 @@ static ssize_t counter_reset_store(struct device *dev,
 	if (ret < 0)
 		return ret;
 
-	ra_net_iow(priv, RA_NET_PP_CNT_RST, v);
+	ra_net_counters_reset_hw(priv, v);
 
 	return count;
 }
@@ -120,16 +311,142 @@ static ssize_t stream_packet_counter_show(struct device *dev,
 }
 static DEVICE_ATTR_RO(stream_packet_counter);
 
+/* PTP path delay compensation */
+
+static ssize_t ra_net_ptp_delay_show(struct device *dev, char *buf,
+				     int idx, bool tx)
+{
+	struct ra_net_priv *priv = netdev_priv(to_net_dev(dev));
+	struct ra_net_ptp_delay *d = &priv->ptp_delay;
+	u16 v;
+
+	mutex_lock(&d->lock);
+	v = tx ? d->tx[idx] : d->rx[idx];
+	mutex_unlock(&d->lock);
+
+	return sysfs_emit(buf, "%u\n", v);
+}
+
+static ssize_t ra_net_ptp_delay_store(struct device *dev,
+				      const char *buf, size_t count,
+				      int idx, bool tx)
+{
+	struct ra_net_priv *priv = netdev_priv(to_net_dev(dev));
+	int ret;
+	u32 v;
+
+	ret = kstrtou32(buf, 0, &v);
+	if (ret < 0)
+		return ret;
+
+	ret = ra_net_ptp_delay_set(priv, idx, tx, v);
+	if (ret < 0)
+		return ret;
+
+	return count;
+}
+
+#define RA_NET_PTP_DELAY_ATTR(_dir, _speed, _idx, _tx)				\
+static ssize_t ptp_delay_##_dir##_##_speed##_ns_show(struct device *dev,	\
+					struct device_attribute *attr,		\
+					char *buf)				\
+{										\
+	return ra_net_ptp_delay_show(dev, buf, _idx, _tx);			\
+}										\
+static ssize_t ptp_delay_##_dir##_##_speed##_ns_store(struct device *dev,	\
+					struct device_attribute *attr,		\
+					const char *buf, size_t count)		\
+{										\
+	return ra_net_ptp_delay_store(dev, buf, count, _idx, _tx);		\
+}										\
+static DEVICE_ATTR_RW(ptp_delay_##_dir##_##_speed##_ns)
+
+RA_NET_PTP_DELAY_ATTR(rx, 10mbit, RA_NET_PTP_DELAY_10MBIT, false);
+RA_NET_PTP_DELAY_ATTR(rx, 100mbit, RA_NET_PTP_DELAY_100MBIT, false);
+RA_NET_PTP_DELAY_ATTR(rx, 1000mbit, RA_NET_PTP_DELAY_1000MBIT, false);
+RA_NET_PTP_DELAY_ATTR(tx, 10mbit, RA_NET_PTP_DELAY_10MBIT, true);
+RA_NET_PTP_DELAY_ATTR(tx, 100mbit, RA_NET_PTP_DELAY_100MBIT, true);
+RA_NET_PTP_DELAY_ATTR(tx, 1000mbit, RA_NET_PTP_DELAY_1000MBIT, true);
+
+static ssize_t ptp_delay_calibrate_show(struct device *dev,
+					struct device_attribute *attr,
+					char *buf)
+{
+	struct ra_net_priv *priv = netdev_priv(to_net_dev(dev));
+	struct ra_net_ptp_delay *d = &priv->ptp_delay;
+	ssize_t ret;
+
+	mutex_lock(&d->lock);
+
+	if (d->suggest.valid)
+		ret = sysfs_emit(buf, "%d %u %u\n", d->suggest.speed,
+				 d->suggest.rx, d->suggest.tx);
+	else
+		ret = sysfs_emit(buf, "none\n");
+
+	mutex_unlock(&d->lock);
+
+	return ret;
+}
+
+static ssize_t ptp_delay_calibrate_store(struct device *dev,
+					 struct device_attribute *attr,
+					 const char *buf, size_t count)
+{
+	struct ra_net_priv *priv = netdev_priv(to_net_dev(dev));
+	s32 time_error, path_delay_error;
+	int ret;
+
+	if (sscanf(buf, "%d %d", &time_error, &path_delay_error) != 2)
+		return -EINVAL;
+
+	ret = ra_net_ptp_delay_calibrate(priv, time_error, path_delay_error);
+	if (ret < 0)
+		return ret;
+
+	return count;
+}
+static DEVICE_ATTR_RW(ptp_delay_calibrate);
+
+static ssize_t counters_read(struct file *filp, struct kobject *kobj,
+			     struct bin_attribute *attr,
+			     char *buf, loff_t off, size_t count)
+{
+	struct ra_net_priv *priv = netdev_priv(to_net_dev(kobj_to_dev(kobj)));
+	struct ra_net_counters snap;
+
+	ra_net_counters_snapshot(priv, &snap);
+
+	return memory_read_from_buffer(buf, count, &off, &snap, sizeof(snap));
+}
+static BIN_ATTR_RO(counters, sizeof(struct ra_net_counters));
+
+static struct bin_attribute *ra_net_bin_attrs[] = {
+	&bin_attr_counters,
+	NULL
+};
+
 static struct attribute *ra_net_attrs[] = {
 	&dev_attr_rav_core_version.attr,
 	&dev_attr_rtp_global_offset.attr,
+	&dev_attr_rtp_global_offset_target.attr,
+	&dev_attr_rtp_global_offset_slew_rate.attr,
+	&dev_attr_rtp_global_offset_slew_status.attr,
 	&dev_attr_counter_reset.attr,
 	&dev_attr_udp_filter_port.attr,
 	&dev_attr_stream_packet_counter.attr,
+	&dev_attr_ptp_delay_rx_10mbit_ns.attr,
+	&dev_attr_ptp_delay_rx_100mbit_ns.attr,
+	&dev_attr_ptp_delay_rx_1000mbit_ns.attr,
+	&dev_attr_ptp_delay_tx_10mbit_ns.attr,
+	&dev_attr_ptp_delay_tx_100mbit_ns.attr,
+	&dev_attr_ptp_delay_tx_1000mbit_ns.attr,
+	&dev_attr_ptp_delay_calibrate.attr,
 	NULL
 };
 
 const struct attribute_group ra_net_attr_group = {
         .name = "ra_net",
         .attrs = ra_net_attrs,
+        .bin_attrs = ra_net_bin_attrs,
 };
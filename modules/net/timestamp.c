@@ -5,6 +5,8 @@
 #include <linux/irq.h>
 #include <linux/module.h>
 #include <linux/netdevice.h>
+#include <linux/of.h>
+#include <linux/ptp_classify.h>
 #include <uapi/linux/net_tstamp.h>
 
 #include "main.h"
@@ -252,16 +254,46 @@ bool ra_net_tx_ts_queue(struct ra_net_priv *priv, struct sk_buff *skb)
 	return true;
 }
 
+/*
+ * The FPGA timestamps every PTP packet once timestamping is enabled, so
+ * the requested filter granularity is applied here: only the messages
+ * the filter asks for get their timestamp converted and attached.
+ */
+static bool ra_net_rx_ts_wanted(struct ra_net_priv *priv, struct sk_buff *skb)
+{
+	struct ptp_header *hdr;
+	unsigned int type;
+
+	type = ptp_classify_raw(skb);
+	if (type == PTP_CLASS_NONE)
+		return false;
+
+	if ((type & PTP_CLASS_PMASK) == PTP_CLASS_L2 && !priv->rx_ts_l2)
+		return false;
+
+	skb_reset_mac_header(skb);
+
+	hdr = ptp_parse_header(skb, type);
+	if (!hdr)
+		return false;
+
+	return priv->rx_ts_msg_types & BIT(ptp_get_msgtype(hdr, type));
+}
+
+/* Must be called before eth_type_trans(), with skb->data at the MAC header */
 void ra_net_rx_apply_timestamp(struct ra_net_priv *priv,
 			       struct sk_buff *skb,
-			       struct ptp_packet_fpga_timestamp *ts)
+			       const struct ptp_packet_fpga_timestamp *ts)
 {
-	struct skb_shared_hwtstamps *ts_ptr = skb_hwtstamps(skb);
+	struct skb_shared_hwtstamps *ts_ptr;
 	u64 ns;
 
 	if (!priv->rx_ts_enable)
 		return;
 
+	if (!ra_net_rx_ts_wanted(priv, skb))
+		return;
+
 	if (ts->start_of_ts != RA_NET_TX_TIMESTAMP_START_OF_TS) {
 		dev_err(priv->dev, "RX timestamp has no SOT\n");
 		return;
@@ -270,17 +302,9 @@ void ra_net_rx_apply_timestamp(struct ra_net_priv *priv,
 	dev_dbg(priv->dev, "Valid rx timestamp found\n");
 
 	ns = (s64)ts->seconds * NSEC_PER_SEC + ts->nanoseconds;
-	ts_ptr->hwtstamp = ns_to_ktime(ns);
-}
-
-void ra_net_rx_read_timestamp(struct ra_net_priv *priv, struct sk_buff *skb)
-{
-	struct ptp_packet_fpga_timestamp ts;
-
-	BUILD_BUG_ON(!IS_ALIGNED(sizeof(ts), sizeof(u32)));
 
-	ra_net_ior_rep(priv, RA_NET_RX_FIFO, &ts, sizeof(ts));
-	ra_net_rx_apply_timestamp(priv, skb, &ts);
+	ts_ptr = skb_hwtstamps(skb);
+	ts_ptr->hwtstamp = ns_to_ktime(ns);
 }
 
 static void ra_net_tx_ts_config(struct ra_net_priv *priv)
@@ -351,16 +375,43 @@ int ra_net_hwtstamp_ioctl(struct net_device *ndev, struct ifreq *ifr, int cmd)
 		ra_net_tx_ts_config(priv);
 		break;
 
+	case HWTSTAMP_FILTER_PTP_V2_EVENT:
 	case HWTSTAMP_FILTER_PTP_V2_L4_EVENT:
+		dev_dbg(dev, "%s(): HWTSTAMP_FILTER_PTP_V2_xxx_EVENT\n",
+			__func__);
+
+		priv->rx_ts_msg_types = BIT(PTP_MSGTYPE_SYNC) |
+					BIT(PTP_MSGTYPE_DELAY_REQ) |
+					BIT(PTP_MSGTYPE_PDELAY_REQ) |
+					BIT(PTP_MSGTYPE_PDELAY_RESP);
+		priv->rx_ts_l2 =
+			config.rx_filter == HWTSTAMP_FILTER_PTP_V2_EVENT;
+		priv->rx_ts_enable = true;
+		ra_net_tx_ts_config(priv);
+		break;
+
+	case HWTSTAMP_FILTER_PTP_V2_SYNC:
 	case HWTSTAMP_FILTER_PTP_V2_L4_SYNC:
-	case HWTSTAMP_FILTER_PTP_V2_L4_DELAY_REQ:
-		dev_dbg(dev, "%s(): HWTSTAMP_FILTER_PTP_V2_L4_xxx\n",
+		dev_dbg(dev, "%s(): HWTSTAMP_FILTER_PTP_V2_xxx_SYNC\n",
 			__func__);
 
+		priv->rx_ts_msg_types = BIT(PTP_MSGTYPE_SYNC);
+		priv->rx_ts_l2 =
+			config.rx_filter == HWTSTAMP_FILTER_PTP_V2_SYNC;
 		priv->rx_ts_enable = true;
 		ra_net_tx_ts_config(priv);
+		break;
 
-		config.rx_filter = HWTSTAMP_FILTER_PTP_V2_L4_EVENT;
+	case HWTSTAMP_FILTER_PTP_V2_DELAY_REQ:
+	case HWTSTAMP_FILTER_PTP_V2_L4_DELAY_REQ:
+		dev_dbg(dev, "%s(): HWTSTAMP_FILTER_PTP_V2_xxx_DELAY_REQ\n",
+			__func__);
+
+		priv->rx_ts_msg_types = BIT(PTP_MSGTYPE_DELAY_REQ);
+		priv->rx_ts_l2 =
+			config.rx_filter == HWTSTAMP_FILTER_PTP_V2_DELAY_REQ;
+		priv->rx_ts_enable = true;
+		ra_net_tx_ts_config(priv);
 		break;
 
 	default:
@@ -374,3 +425,176 @@ int ra_net_hwtstamp_ioctl(struct net_device *ndev, struct ifreq *ifr, int cmd)
 
 	return 0;
 }
+
+/* PTP path delay compensation */
+
+static const char * const ra_net_ptp_delay_names[RA_NET_PTP_DELAY_SPEEDS] = {
+	[RA_NET_PTP_DELAY_10MBIT]	= "10mbit",
+	[RA_NET_PTP_DELAY_100MBIT]	= "100mbit",
+	[RA_NET_PTP_DELAY_1000MBIT]	= "1000mbit",
+};
+
+int ra_net_ptp_delay_index(int speed)
+{
+	switch (speed) {
+	case SPEED_10:
+		return RA_NET_PTP_DELAY_10MBIT;
+	case SPEED_100:
+		return RA_NET_PTP_DELAY_100MBIT;
+	case SPEED_1000:
+		return RA_NET_PTP_DELAY_1000MBIT;
+	default:
+		return -EINVAL;
+	}
+}
+
+/* Must be called with priv->ptp_delay.lock held */
+static void __ra_net_ptp_delay_write(struct ra_net_priv *priv)
+{
+	struct ra_net_ptp_delay *d = &priv->ptp_delay;
+	int idx = ra_net_ptp_delay_index(d->speed);
+	u32 v;
+
+	if (idx < 0)
+		idx = RA_NET_PTP_DELAY_1000MBIT;
+
+	v = d->rx[RA_NET_PTP_DELAY_1000MBIT] |
+	    d->rx[RA_NET_PTP_DELAY_100MBIT] << 16;
+	dev_dbg(priv->dev, "RA_NET_PTP_DELAY_ADJUST_1 = 0x%08x\n", v);
+	ra_net_iow(priv, RA_NET_PTP_DELAY_ADJUST_1, v);
+
+	v = d->rx[RA_NET_PTP_DELAY_10MBIT] | d->tx[idx] << 16;
+	dev_dbg(priv->dev, "RA_NET_PTP_DELAY_ADJUST_2 = 0x%08x\n", v);
+	ra_net_iow(priv, RA_NET_PTP_DELAY_ADJUST_2, v);
+}
+
+void ra_net_ptp_delay_apply(struct ra_net_priv *priv, int speed)
+{
+	struct ra_net_ptp_delay *d = &priv->ptp_delay;
+
+	mutex_lock(&d->lock);
+	d->speed = speed;
+	__ra_net_ptp_delay_write(priv);
+	mutex_unlock(&d->lock);
+}
+
+int ra_net_ptp_delay_set(struct ra_net_priv *priv, int idx, bool tx, u32 ns)
+{
+	struct ra_net_ptp_delay *d = &priv->ptp_delay;
+
+	if (idx < 0 || idx >= RA_NET_PTP_DELAY_SPEEDS || ns > U16_MAX)
+		return -EINVAL;
+
+	mutex_lock(&d->lock);
+
+	if (tx)
+		d->tx[idx] = ns;
+	else
+		d->rx[idx] = ns;
+
+	__ra_net_ptp_delay_write(priv);
+
+	mutex_unlock(&d->lock);
+
+	return 0;
+}
+
+/*
+ * Suggest path delays for the current link speed from a measurement
+ * against a reference clock over a link with a known delay:
+ *
+ *  - time_error_ns is the offset of this clock from the reference,
+ *    as measured externally, e.g. by comparing PPS outputs.
+ *  - path_delay_error_ns is the mean path delay reported by the PTP
+ *    stack minus the known delay of the link.
+ *
+ * An uncompensated RX latency d_rx and TX latency d_tx make the stack
+ * see a path delay of true + (d_rx + d_tx) / 2, and the servo settles
+ * at a time error of -(d_rx - d_tx) / 2. Solving for both gives the
+ * corrections below, which are added to the values currently in use.
+ */
+int ra_net_ptp_delay_calibrate(struct ra_net_priv *priv,
+			       s32 time_error_ns, s32 path_delay_error_ns)
+{
+	struct ra_net_ptp_delay *d = &priv->ptp_delay;
+	s64 rx, tx;
+	int idx;
+
+	mutex_lock(&d->lock);
+
+	idx = ra_net_ptp_delay_index(d->speed);
+	if (idx < 0) {
+		mutex_unlock(&d->lock);
+		return -ENOLINK;
+	}
+
+	rx = (s64)d->rx[idx] + path_delay_error_ns - time_error_ns;
+	tx = (s64)d->tx[idx] + path_delay_error_ns + time_error_ns;
+
+	d->suggest.speed = d->speed;
+	d->suggest.rx = clamp_t(s64, rx, 0, U16_MAX);
+	d->suggest.tx = clamp_t(s64, tx, 0, U16_MAX);
+	d->suggest.valid = true;
+
+	mutex_unlock(&d->lock);
+
+	if (rx != d->suggest.rx || tx != d->suggest.tx)
+		dev_warn(priv->dev,
+			 "suggested PTP path delays out of range (rx %lld, tx %lld)\n",
+			 rx, tx);
+
+	return 0;
+}
+
+/*
+ * The TX delay can be given per speed, falling back to the legacy
+ * property for all speeds. If the device tree has no delays at all,
+ * the values currently programmed into the hardware are kept.
+ */
+void ra_net_ptp_delay_init(struct ra_net_priv *priv)
+{
+	struct ra_net_ptp_delay *d = &priv->ptp_delay;
+	struct device_node *node = priv->dev->of_node;
+	bool found = false;
+	char prop[48];
+	u32 adj1, adj2;
+	u32 tx_all;
+	int i;
+
+	mutex_init(&d->lock);
+	d->speed = SPEED_UNKNOWN;
+
+	adj1 = ra_net_ior(priv, RA_NET_PTP_DELAY_ADJUST_1);
+	adj2 = ra_net_ior(priv, RA_NET_PTP_DELAY_ADJUST_2);
+
+	d->rx[RA_NET_PTP_DELAY_1000MBIT] = adj1 & 0xffff;
+	d->rx[RA_NET_PTP_DELAY_100MBIT] = adj1 >> 16;
+	d->rx[RA_NET_PTP_DELAY_10MBIT] = adj2 & 0xffff;
+
+	tx_all = adj2 >> 16;
+	if (!of_property_read_u32(node, "lawo,ptp-delay-path-tx-nsec", &tx_all))
+		found = true;
+
+	for (i = 0; i < RA_NET_PTP_DELAY_SPEEDS; i++) {
+		u32 v;
+
+		d->tx[i] = tx_all;
+
+		snprintf(prop, sizeof(prop), "lawo,ptp-delay-path-rx-%s-nsec",
+			 ra_net_ptp_delay_names[i]);
+		if (!of_property_read_u32(node, prop, &v)) {
+			d->rx[i] = v;
+			found = true;
+		}
+
+		snprintf(prop, sizeof(prop), "lawo,ptp-delay-path-tx-%s-nsec",
+			 ra_net_ptp_delay_names[i]);
+		if (!of_property_read_u32(node, prop, &v)) {
+			d->tx[i] = v;
+			found = true;
+		}
+	}
+
+	if (found)
+		ra_net_ptp_delay_apply(priv, SPEED_UNKNOWN);
+}
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ravenna_net
+
+#if !defined(RA_NET_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define RA_NET_TRACE_H
+
+#include <linux/netdevice.h>
+#include <linux/tracepoint.h>
+
+/*
+ * These events are only emitted while the latency instrumentation is
+ * enabled through debugfs, since the timestamps are taken on demand.
+ */
+
+TRACE_EVENT(ra_net_rx_irq_to_poll,
+	TP_PROTO(struct net_device *ndev, u64 delay_ns),
+	TP_ARGS(ndev, delay_ns),
+
+	TP_STRUCT__entry(
+		__string(name, ndev->name)
+		__field(u64, delay_ns)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, ndev->name);
+		__entry->delay_ns = delay_ns;
+	),
+
+	TP_printk("%s delay=%llu ns", __get_str(name), __entry->delay_ns)
+);
+
+TRACE_EVENT(ra_net_rx_fifo_read,
+	TP_PROTO(struct net_device *ndev, u32 len, u64 duration_ns),
+	TP_ARGS(ndev, len, duration_ns),
+
+	TP_STRUCT__entry(
+		__string(name, ndev->name)
+		__field(u32, len)
+		__field(u64, duration_ns)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, ndev->name);
+		__entry->len = len;
+		__entry->duration_ns = duration_ns;
+	),
+
+	TP_printk("%s len=%u duration=%llu ns", __get_str(name),
+		  __entry->len, __entry->duration_ns)
+);
+
+TRACE_EVENT(ra_net_rx_napi_batch,
+	TP_PROTO(struct net_device *ndev, int count, int budget),
+	TP_ARGS(ndev, count, budget),
+
+	TP_STRUCT__entry(
+		__string(name, ndev->name)
+		__field(int, count)
+		__field(int, budget)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, ndev->name);
+		__entry->count = count;
+		__entry->budget = budget;
+	),
+
+	TP_printk("%s count=%d budget=%d", __get_str(name),
+		  __entry->count, __entry->budget)
+);
+
+#endif /* RA_NET_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE trace
+
+#include <trace/define_trace.h>
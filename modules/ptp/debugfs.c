@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include <ravenna/version.h>
+
+#include "main.h"
+
+static int ra_ptp_summary_show(struct seq_file *s, void *p)
+{
+	struct ra_ptp_priv *priv = s->private;
+
+	seq_printf(s, "Driver version: %s\n", ra_driver_version());
+	seq_printf(s, "Clock index: %d\n", ptp_clock_index(priv->ptp_clock));
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(ra_ptp_summary);
+
+static int ra_ptp_latch_delay_show(struct seq_file *s, void *p)
+{
+	struct ra_ptp_priv *priv = s->private;
+	struct ra_ptp_hist h;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&priv->lock, flags);
+	h = priv->latch_delay;
+	spin_unlock_irqrestore(&priv->lock, flags);
+
+	for (i = 0; i < RA_PTP_HIST_BUCKETS; i++) {
+		if (!h.buckets[i])
+			continue;
+
+		if (i == 0)
+			seq_printf(s, "%10u            : %llu\n", 0, h.buckets[i]);
+		else if (i == RA_PTP_HIST_BUCKETS - 1)
+			seq_printf(s, "%10llu and above  : %llu\n",
+				   BIT_ULL(i - 1), h.buckets[i]);
+		else
+			seq_printf(s, "%10llu - %10llu: %llu\n",
+				   BIT_ULL(i - 1), BIT_ULL(i) - 1, h.buckets[i]);
+	}
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(ra_ptp_latch_delay);
+
+static int ra_ptp_latch_delay_reset_set(void *data, u64 val)
+{
+	struct ra_ptp_priv *priv = data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&priv->lock, flags);
+	memset(&priv->latch_delay, 0, sizeof(priv->latch_delay));
+	spin_unlock_irqrestore(&priv->lock, flags);
+
+	return 0;
+}
+
+DEFINE_DEBUGFS_ATTRIBUTE(ra_ptp_latch_delay_reset_fops,
+			 NULL, ra_ptp_latch_delay_reset_set, "%llu\n");
+
+static int ra_ptp_timebase_show(struct seq_file *s, void *p)
+{
+	struct ra_ptp_priv *priv = s->private;
+	struct ra_ptp_timebase *tb = &priv->tb;
+	s64 rate_ppb, last_err_ns;
+	unsigned long flags;
+	u64 max_err_ns;
+	s32 adj_ppb;
+	bool valid;
+
+	spin_lock_irqsave(&priv->lock, flags);
+	valid = tb->valid;
+	rate_ppb = tb->rate_ppb;
+	adj_ppb = tb->adj_ppb;
+	last_err_ns = tb->last_err_ns;
+	max_err_ns = tb->max_err_ns;
+	spin_unlock_irqrestore(&priv->lock, flags);
+
+	seq_printf(s, "Valid: %d\n", valid);
+	seq_printf(s, "Rate vs. CLOCK_MONOTONIC_RAW: %lld ppb\n", rate_ppb);
+	seq_printf(s, "Drift correction: %d ppb\n", adj_ppb);
+	seq_printf(s, "Last extrapolation error: %lld ns\n", last_err_ns);
+	seq_printf(s, "Max extrapolation error: %llu ns\n", max_err_ns);
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(ra_ptp_timebase);
+
+static int ra_ptp_extts_show(struct seq_file *s, void *p)
+{
+	struct ra_ptp_priv *priv = s->private;
+	struct ra_ptp_extts *extts = &priv->extts;
+	u64 events, hw_overflows;
+	unsigned long flags;
+
+	spin_lock_irqsave(&extts->lock, flags);
+	events = extts->events;
+	hw_overflows = extts->hw_overflows;
+	spin_unlock_irqrestore(&extts->lock, flags);
+
+	seq_printf(s, "Events: %llu\n", events);
+	seq_printf(s, "Hardware FIFO overflows: %llu\n", hw_overflows);
+	seq_printf(s, "Ring overflows (words): %llu\n",
+		   READ_ONCE(extts->ring_overflows));
+	seq_printf(s, "Misaligned words: %llu\n", READ_ONCE(extts->misaligned));
+	seq_printf(s, "Ring fill (words): %u/%u\n",
+		   kfifo_len(&extts->words), kfifo_size(&extts->words));
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(ra_ptp_extts);
+
+static void ra_ptp_remove_debugfs(void *root)
+{
+	debugfs_remove_recursive(root);
+}
+
+int ra_ptp_debugfs_init(struct ra_ptp_priv *priv)
+{
+	int ret;
+
+	priv->debugfs = debugfs_create_dir(dev_name(priv->dev), NULL);
+	if (IS_ERR(priv->debugfs))
+		return PTR_ERR(priv->debugfs);
+
+	ret = devm_add_action_or_reset(priv->dev, ra_ptp_remove_debugfs,
+				       priv->debugfs);
+	if (ret < 0)
+		return ret;
+
+	debugfs_create_file("summary", 0444, priv->debugfs,
+			    priv, &ra_ptp_summary_fops);
+	debugfs_create_file("latch_delay_ns", 0444, priv->debugfs,
+			    priv, &ra_ptp_latch_delay_fops);
+	debugfs_create_file("latch_delay_reset", 0200, priv->debugfs,
+			    priv, &ra_ptp_latch_delay_reset_fops);
+	debugfs_create_file("timebase", 0444, priv->debugfs,
+			    priv, &ra_ptp_timebase_fops);
+	debugfs_create_file("extts", 0444, priv->debugfs,
+			    priv, &ra_ptp_extts_fops);
+
+	ra_ptp_monitor_debugfs_init(priv, priv->debugfs);
+
+	return 0;
+}
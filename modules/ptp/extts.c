@@ -0,0 +1,332 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// #define DEBUG 1
+
+#include <linux/fs.h>
+#include <linux/kfifo.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+
+#include "main.h"
+
+#define RA_PTP_EXTTS_READER_FIFO_SIZE	256
+#define RA_PTP_EXTTS_READ_BATCH		16
+
+struct ra_ptp_extts_reader {
+	struct ra_ptp_priv	*priv;
+	struct list_head	node;
+	DECLARE_KFIFO(fifo, struct ra_ptp_extts_event,
+		      RA_PTP_EXTTS_READER_FIFO_SIZE);
+	u64			overruns;
+};
+
+#define to_ra_ptp_priv_extts(m) \
+	container_of(m, struct ra_ptp_priv, extts.misc)
+
+/*
+ * Hand an event to all readers. When a reader's queue is full, its oldest
+ * event is dropped, as recent pairs are the more useful ones.
+ */
+static void ra_ptp_extts_queue(struct ra_ptp_priv *priv, u64 ptp_ns,
+			       u32 rtp_ts)
+{
+	struct ra_ptp_extts *extts = &priv->extts;
+	struct ra_ptp_extts_reader *reader;
+	struct ra_ptp_extts_event ev;
+	unsigned long flags;
+
+	spin_lock_irqsave(&extts->lock, flags);
+
+	ev.ptp_ns = ptp_ns;
+	ev.rtp_ts = rtp_ts;
+	ev.seq = extts->seq++;
+	extts->events++;
+
+	list_for_each_entry(reader, &extts->readers, node) {
+		if (kfifo_is_full(&reader->fifo)) {
+			kfifo_skip(&reader->fifo);
+			reader->overruns++;
+		}
+
+		kfifo_put(&reader->fifo, ev);
+	}
+
+	spin_unlock_irqrestore(&extts->lock, flags);
+
+	wake_up_interruptible(&extts->wait);
+}
+
+/*
+ * Hard IRQ half: move everything the hardware FIFO holds into the ring
+ * with one burst read. Returns true if the IRQ thread has work to do.
+ */
+bool ra_ptp_extts_drain(struct ra_ptp_priv *priv)
+{
+	u32 words[RA_PTP_EXTTS_MAX_TS_CNT * RA_PTP_EXTTS_EVENT_WORDS];
+	struct ra_ptp_extts *extts = &priv->extts;
+	bool overflow = false;
+	unsigned int n, in;
+	u32 ts_cnt;
+
+	spin_lock(&priv->lock);
+
+	ts_cnt = ra_ptp_ior(priv, RA_PTP_EXTTS_TS_CNT);
+
+	if (ts_cnt >= RA_PTP_EXTTS_MAX_TS_CNT) {
+		u32 status = ra_ptp_ior(priv, RA_PTP_STATUS);
+
+		if (status & RA_PTP_STATUS_EXTTS_FIFO_OVFLW) {
+			ra_ptp_cmd(priv, RA_PTP_CMD_RESET_EXTTS_FIFO_OVFLW);
+			overflow = true;
+		}
+	}
+
+	ts_cnt = min_t(u32, ts_cnt, RA_PTP_EXTTS_MAX_TS_CNT);
+	n = ts_cnt * RA_PTP_EXTTS_EVENT_WORDS;
+	ra_ptp_ior_rep(priv, RA_PTP_EXTTS_DATA, words, n * sizeof(u32));
+
+	spin_unlock(&priv->lock);
+
+	if (overflow) {
+		spin_lock(&extts->lock);
+		extts->hw_overflows++;
+		spin_unlock(&extts->lock);
+
+		dev_err_ratelimited(priv->dev,
+			"PTP hw clock: event timestamp FIFO overflow!"
+			" => Event timestamp(s) may be lost or damaged\n");
+	}
+
+	in = kfifo_in(&extts->words, words, n);
+	if (in < n)
+		WRITE_ONCE(extts->ring_overflows, extts->ring_overflows + n - in);
+
+	dev_dbg(priv->dev, "%s() ts_cnt %d\n", __func__, ts_cnt);
+
+	return n > 0;
+}
+
+/*
+ * IRQ thread half: parse the ring, resynchronizing on the start of
+ * timestamp marker, and deliver the events.
+ */
+void ra_ptp_extts_process(struct ra_ptp_priv *priv)
+{
+	struct ra_ptp_extts *extts = &priv->extts;
+	unsigned long flags;
+
+	while (kfifo_len(&extts->words) >= RA_PTP_EXTTS_EVENT_WORDS) {
+		struct ra_ptp_extts_fpga_timestamp ts;
+		struct ptp_clock_event event = {
+			.type = PTP_CLOCK_EXTTS,
+		};
+		u32 sot, seconds_hi;
+		u64 seconds;
+
+		if (!kfifo_peek(&extts->words, &sot))
+			break;
+
+		if ((sot >> 16) != RA_PTP_EXTTS_START_OF_TS) {
+			dev_dbg(priv->dev, "%s(): no start of timestamp: 0x%08x\n",
+				__func__, sot);
+			kfifo_skip(&extts->words);
+			WRITE_ONCE(extts->misaligned, extts->misaligned + 1);
+			continue;
+		}
+
+		if (kfifo_out(&extts->words, (u32 *)&ts,
+			      RA_PTP_EXTTS_EVENT_WORDS) != RA_PTP_EXTTS_EVENT_WORDS)
+			break;
+
+		seconds_hi = sot & 0xffff;
+		seconds = ((u64)seconds_hi << 32ULL) + ts.seconds;
+
+		event.timestamp = seconds * NSEC_PER_SEC + ts.nanoseconds;
+
+		spin_lock_irqsave(&priv->lock, flags);
+		priv->last_ptp_timestamp = event.timestamp;
+		priv->last_rtp_timestamp = ts.rtp_ts;
+		spin_unlock_irqrestore(&priv->lock, flags);
+
+		dev_dbg(priv->dev, "%s(): event TS %lld\n",
+			__func__, event.timestamp);
+
+		ptp_clock_event(priv->ptp_clock, &event);
+		ra_ptp_extts_queue(priv, event.timestamp, ts.rtp_ts);
+		ra_ptp_monitor_extts(priv, event.timestamp);
+	}
+}
+
+static bool ra_ptp_extts_reader_empty(struct ra_ptp_extts_reader *reader)
+{
+	struct ra_ptp_extts *extts = &reader->priv->extts;
+	unsigned long flags;
+	bool empty;
+
+	spin_lock_irqsave(&extts->lock, flags);
+	empty = kfifo_is_empty(&reader->fifo);
+	spin_unlock_irqrestore(&extts->lock, flags);
+
+	return empty;
+}
+
+static int ra_ptp_extts_open(struct inode *inode, struct file *filp)
+{
+	struct ra_ptp_priv *priv = to_ra_ptp_priv_extts(filp->private_data);
+	struct ra_ptp_extts_reader *reader;
+	unsigned long flags;
+
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
+	reader->priv = priv;
+	INIT_KFIFO(reader->fifo);
+
+	spin_lock_irqsave(&priv->extts.lock, flags);
+	list_add_tail(&reader->node, &priv->extts.readers);
+	spin_unlock_irqrestore(&priv->extts.lock, flags);
+
+	filp->private_data = reader;
+
+	return stream_open(inode, filp);
+}
+
+static int ra_ptp_extts_release(struct inode *inode, struct file *filp)
+{
+	struct ra_ptp_extts_reader *reader = filp->private_data;
+	struct ra_ptp_extts *extts = &reader->priv->extts;
+	unsigned long flags;
+
+	spin_lock_irqsave(&extts->lock, flags);
+	list_del(&reader->node);
+	spin_unlock_irqrestore(&extts->lock, flags);
+
+	kfree(reader);
+
+	return 0;
+}
+
+static ssize_t ra_ptp_extts_read(struct file *filp, char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	struct ra_ptp_extts_reader *reader = filp->private_data;
+	struct ra_ptp_extts *extts = &reader->priv->extts;
+	struct ra_ptp_extts_event ev[RA_PTP_EXTTS_READ_BATCH];
+	size_t n = count / sizeof(ev[0]);
+	unsigned long flags;
+	ssize_t done = 0;
+	int ret;
+
+	if (n == 0)
+		return -EINVAL;
+
+	if (filp->f_flags & O_NONBLOCK) {
+		if (ra_ptp_extts_reader_empty(reader))
+			return -EAGAIN;
+	} else {
+		ret = wait_event_interruptible(extts->wait,
+				!ra_ptp_extts_reader_empty(reader));
+		if (ret < 0)
+			return ret;
+	}
+
+	while (n) {
+		unsigned int got;
+
+		spin_lock_irqsave(&extts->lock, flags);
+		got = kfifo_out(&reader->fifo, ev,
+				min_t(size_t, n, ARRAY_SIZE(ev)));
+		spin_unlock_irqrestore(&extts->lock, flags);
+
+		if (!got)
+			break;
+
+		if (copy_to_user(buf + done, ev, got * sizeof(ev[0])))
+			return done ? done : -EFAULT;
+
+		done += got * sizeof(ev[0]);
+		n -= got;
+	}
+
+	return done;
+}
+
+static __poll_t ra_ptp_extts_poll(struct file *filp, poll_table *wait)
+{
+	struct ra_ptp_extts_reader *reader = filp->private_data;
+
+	poll_wait(filp, &reader->priv->extts.wait, wait);
+
+	if (!ra_ptp_extts_reader_empty(reader))
+		return EPOLLIN | EPOLLRDNORM;
+
+	return 0;
+}
+
+static long ra_ptp_extts_ioctl(struct file *filp,
+			       unsigned int cmd,
+			       unsigned long arg)
+{
+	struct ra_ptp_extts_reader *reader = filp->private_data;
+	struct ra_ptp_extts *extts = &reader->priv->extts;
+	void __user *buf = (void __user *)arg;
+	struct ra_ptp_extts_stats stats;
+	unsigned long flags;
+
+	switch (cmd) {
+	case RA_PTP_EXTTS_GET_STATS:
+		spin_lock_irqsave(&extts->lock, flags);
+		stats.events = extts->events;
+		stats.overruns = reader->overruns;
+		stats.hw_overflows = extts->hw_overflows;
+		spin_unlock_irqrestore(&extts->lock, flags);
+
+		if (copy_to_user(buf, &stats, sizeof(stats)))
+			return -EFAULT;
+
+		return 0;
+	}
+
+	return -ENOTTY;
+}
+
+static const struct file_operations ra_ptp_extts_fops =
+{
+	.owner		= THIS_MODULE,
+	.open		= ra_ptp_extts_open,
+	.release	= ra_ptp_extts_release,
+	.read		= ra_ptp_extts_read,
+	.poll		= ra_ptp_extts_poll,
+	.unlocked_ioctl	= ra_ptp_extts_ioctl,
+	.llseek		= no_llseek,
+};
+
+static void ra_ptp_extts_misc_deregister(void *misc)
+{
+	misc_deregister(misc);
+}
+
+int ra_ptp_extts_init(struct ra_ptp_priv *priv)
+{
+	struct ra_ptp_extts *extts = &priv->extts;
+	struct device *dev = priv->dev;
+	int ret;
+
+	extts->misc.name = devm_kasprintf(dev, GFP_KERNEL, "ptp%d-extts",
+					  ptp_clock_index(priv->ptp_clock));
+	if (!extts->misc.name)
+		return -ENOMEM;
+
+	extts->misc.minor = MISC_DYNAMIC_MINOR;
+	extts->misc.fops = &ra_ptp_extts_fops;
+	extts->misc.parent = dev;
+
+	ret = misc_register(&extts->misc);
+	if (ret < 0)
+		return ret;
+
+	return devm_add_action_or_reset(dev, ra_ptp_extts_misc_deregister,
+					&extts->misc);
+}
@@ -12,37 +12,19 @@
 #include <linux/pps_kernel.h>
 #include <linux/ptp_clock_kernel.h>
 #include <linux/clk.h>
+#include <linux/timekeeping.h>
 
-#include "regs.h"
+#include "main.h"
 
 #define RA_EVENT_OUT_MAX_PERIOD		(1 * NSEC_PER_SEC)
+/* the first edge of a periodic output is at least this far in the future */
+#define RA_EVENT_OUT_MIN_LEAD		(10 * NSEC_PER_MSEC)
 #define RA_PTP_ADJ_TIME_MAX_OFFSET	(1 * NSEC_PER_SEC)
-
-struct ra_ptp_priv {
-	struct device		*dev;
-	void __iomem		*regs;
-	struct ptp_clock	*ptp_clock;
-	struct ptp_clock_info	ptp_clock_info;
-	u64			last_ptp_timestamp;
-	u32			last_rtp_timestamp;
-	spinlock_t		lock;
-};
-
-static u32 ra_ptp_ior(struct ra_ptp_priv *priv, off_t reg)
-{
-	return ioread32(priv->regs + reg);
-}
-
-static void ra_ptp_ior_rep(struct ra_ptp_priv *priv, off_t reg,
-			   void *dst, size_t len)
-{
-	ioread32_rep(priv->regs + reg, dst, len / sizeof(u32));
-}
-
-static void ra_ptp_iow(struct ra_ptp_priv *priv, off_t reg, u32 val)
-{
-	iowrite32(val, priv->regs + reg);
-}
+#define RA_PTP_ADJ_TIME_SPLIT_MAX_NS	(64LL * NSEC_PER_SEC)
+#define RA_PTP_ADJ_TIME_STEP_SETTLE_US	1
+#define RA_PTP_ADJ_PHASE_MAX_NS		(1 * NSEC_PER_MSEC)
+#define RA_PTP_ADJ_PHASE_STEP_NS	1000
+#define RA_PTP_ADJ_PHASE_PERIOD_NS	(10 * NSEC_PER_MSEC)
 
 static void ra_ptp_write_mask(struct ra_ptp_priv *priv,
 			      off_t reg, u32 mask, u32 val)
@@ -60,18 +42,25 @@ static void ra_ptp_write_mask(struct ra_ptp_priv *priv,
 	spin_unlock_irqrestore(&priv->lock, flags);
 }
 
-static void ra_ptp_cmd(struct ra_ptp_priv *priv, u32 cmd)
-{
-	ra_ptp_iow(priv, RA_PTP_CMD, cmd);
-}
-
-static int ra_ptp_set_per_out(struct ra_ptp_priv *priv, int ns)
+/*
+ * Program the event output. @start is the time of the first edge, or NULL
+ * to keep the one programmed before. @width is the pulse length in ns, or
+ * negative to keep the current one.
+ */
+static int ra_ptp_set_per_out(struct ra_ptp_priv *priv, u64 ns,
+			      const struct timespec64 *start, s64 width)
 {
 	struct device *dev = priv->dev;
 	unsigned long flags;
 
 	if (ns > RA_EVENT_OUT_MAX_PERIOD) {
-		dev_err(dev, "Invalid interval for periodic output: %d\n", ns);
+		dev_err(dev, "Invalid interval for periodic output: %llu\n", ns);
+		return -EINVAL;
+	}
+
+	if (width >= 0 && ns > 0 && width >= ns) {
+		dev_err(dev, "Invalid pulse length for periodic output: %lld\n",
+			width);
 		return -EINVAL;
 	}
 
@@ -80,12 +69,21 @@ static int ra_ptp_set_per_out(struct ra_ptp_priv *priv, int ns)
 	ra_ptp_iow(priv, RA_PTP_EVENT_OUT_MODE, 0);
 	ra_ptp_iow(priv, RA_PTP_EVENT_OUT_NS_INTERVAL, ns);
 
+	if (start) {
+		ra_ptp_iow(priv, RA_PTP_EVENT_OUT_SECONDS_H, start->tv_sec >> 32ULL);
+		ra_ptp_iow(priv, RA_PTP_EVENT_OUT_SECONDS, start->tv_sec);
+		ra_ptp_iow(priv, RA_PTP_EVENT_OUT_NANOSECONDS, start->tv_nsec);
+	}
+
+	if (width >= 0)
+		ra_ptp_iow(priv, RA_PTP_PPS_LENGTH, width);
+
 	if (ns > 0) {
 		ra_ptp_iow(priv, RA_PTP_EVENT_OUT_MODE,
 			   RA_PTP_EVENT_OUT_MODE_PERIODIC |
 			   RA_PTP_EVENT_OUT_MODE_ENABLE);
 
-		dev_info(dev, "Periodic output activated with interval of %d ns\n", ns);
+		dev_info(dev, "Periodic output activated with interval of %llu ns\n", ns);
 	} else {
 		dev_info(dev, "Periodic output deactivated\n");
 	}
@@ -95,69 +93,203 @@ static int ra_ptp_set_per_out(struct ra_ptp_priv *priv, int ns)
 	return 0;
 }
 
+/* Called with priv->lock held */
+static void ra_ptp_write_drift(struct ra_ptp_priv *priv, s32 ppb)
+{
+	u32 val = 0;
+
+	priv->drift_ppb = ppb;
+
+	if (ppb < 0) {
+		ppb = -ppb;
+		val |= RA_PTP_DRIFT_CORRECTION_NEGATIVE;
+	}
+
+	val |= ppb & RA_PTP_DRIFT_CORRECTION_PPB_VALUE_MASK;
+
+	ra_ptp_iow(priv, RA_PTP_DRIFT_CORRECTION, val);
+	ra_ptp_cmd(priv, RA_PTP_CMD_APPLY_DRIFT_CORRECTION);
+
+	ra_ptp_timebase_set_rate(priv, priv->drift_ppb);
+}
+
 /*
- * PTP clock operations
+ * First order sigma-delta: program the integer part and carry the
+ * remainder over to the next period. Called with priv->lock held.
  */
+static void ra_ptp_dither_step(struct ra_ptp_priv *priv, bool force)
+{
+	struct ra_ptp_dither *d = &priv->dither;
+	s64 want = d->target + d->acc;
+	s32 ppb = want >> RA_PTP_DITHER_FRAC_BITS;
 
-#define to_ra_ptp_priv(ptp) \
-	container_of(ptp, struct ra_ptp_priv, ptp_clock_info)
+	d->acc = want - ((s64)ppb << RA_PTP_DITHER_FRAC_BITS);
+
+	if (force || ppb != priv->drift_ppb)
+		ra_ptp_write_drift(priv, ppb);
+}
+
+static bool ra_ptp_dither_needed(struct ra_ptp_priv *priv)
+{
+	struct ra_ptp_dither *d = &priv->dither;
+
+	return d->enable &&
+	       (d->target & GENMASK_ULL(RA_PTP_DITHER_FRAC_BITS - 1, 0));
+}
+
+static enum hrtimer_restart ra_ptp_dither_timer(struct hrtimer *timer)
+{
+	struct ra_ptp_priv *priv =
+		container_of(timer, struct ra_ptp_priv, dither.timer);
+	unsigned long flags;
+	bool restart;
+
+	/*
+	 * 'running' is only cleared here and in the cancel paths, under the
+	 * lock, so adjfine() can tell whether it has to start the timer.
+	 * Restarting from here is decided under the same lock.
+	 */
+	spin_lock_irqsave(&priv->lock, flags);
+
+	restart = ra_ptp_dither_needed(priv);
+	if (restart) {
+		ra_ptp_dither_step(priv, false);
+		hrtimer_forward_now(timer, ns_to_ktime(RA_PTP_DITHER_PERIOD_NS));
+	} else {
+		priv->dither.running = false;
+	}
+
+	spin_unlock_irqrestore(&priv->lock, flags);
+
+	return restart ? HRTIMER_RESTART : HRTIMER_NORESTART;
+}
+
+static void ra_ptp_dither_stop(struct ra_ptp_priv *priv)
+{
+	unsigned long flags;
+
+	hrtimer_cancel(&priv->dither.timer);
+
+	spin_lock_irqsave(&priv->lock, flags);
+	priv->dither.running = false;
+	spin_unlock_irqrestore(&priv->lock, flags);
+}
+
+static void ra_ptp_dither_cancel(void *data)
+{
+	struct ra_ptp_priv *priv = data;
+
+	ra_ptp_dither_stop(priv);
+}
+
+/*
+ * PTP clock operations
+ */
 
 static int ra_ptp_adjfine(struct ptp_clock_info *ptp, long scaled_ppm)
 {
 	struct ra_ptp_priv *priv = to_ra_ptp_priv(ptp);
 	s32 ppb = scaled_ppm_to_ppb(scaled_ppm);
+	/* scaled_ppm has a 16 bit fraction, so this is ppb with the same */
+	s64 target = (s64)scaled_ppm * 1000;
+	s64 max = (s64)RA_PTP_DRIFT_CORRECTION_MAX_PPB << RA_PTP_DITHER_FRAC_BITS;
 	unsigned long flags;
-	u32 val = 0;
-
-	if (ppb == 0)
-		return 0;
 
-	if (ppb < 0) {
-		ppb = -ppb;
-		val |= RA_PTP_DRIFT_CORRECTION_NEGATIVE;
-	}
+	ra_ptp_monitor_log(priv, RA_PTP_SERVO_ADJFINE, scaled_ppm);
 
-	if (ppb > RA_PTP_DRIFT_CORRECTION_MAX_PPB) {
+	if (abs(ppb) > RA_PTP_DRIFT_CORRECTION_MAX_PPB) {
 		dev_info(priv->dev,
 			 "PTP hw clock adjust: requested ppb %d beyond "
 			 "max. drift correction %i => limiting\n",
 			 ppb, RA_PTP_DRIFT_CORRECTION_MAX_PPB);
-		ppb = RA_PTP_DRIFT_CORRECTION_MAX_PPB;
+		ppb = clamp(ppb, -RA_PTP_DRIFT_CORRECTION_MAX_PPB,
+			    RA_PTP_DRIFT_CORRECTION_MAX_PPB);
 	}
 
-	val |= ppb & RA_PTP_DRIFT_CORRECTION_PPB_VALUE_MASK;
+	/* ppb is truncated, the fraction of the target may still exceed max */
+	target = clamp(target, -max, max);
 
 	spin_lock_irqsave(&priv->lock, flags);
-	ra_ptp_iow(priv, RA_PTP_DRIFT_CORRECTION, val);
-	ra_ptp_cmd(priv, RA_PTP_CMD_APPLY_DRIFT_CORRECTION);
+
+	if (priv->dither.enable) {
+		priv->dither.target = target;
+		ra_ptp_dither_step(priv, true);
+
+		if (ra_ptp_dither_needed(priv) && !priv->dither.running) {
+			priv->dither.running = true;
+			hrtimer_start(&priv->dither.timer,
+				      ns_to_ktime(RA_PTP_DITHER_PERIOD_NS),
+				      HRTIMER_MODE_REL);
+		}
+	} else {
+		ra_ptp_write_drift(priv, ppb);
+	}
+
 	spin_unlock_irqrestore(&priv->lock, flags);
 
 	return 0;
 }
 
-static int ra_ptp_gettime(struct ptp_clock_info *ptp, struct timespec64 *ts)
+/*
+ * Latch and read the hardware clock. Must be called with priv->lock held.
+ * @raw_ns, if given, receives CLOCK_MONOTONIC_RAW at the latch.
+ */
+int __ra_ptp_read_clock(struct ra_ptp_priv *priv, struct timespec64 *ts,
+			struct ptp_system_timestamp *sts, u64 *raw_ns)
 {
-	struct ra_ptp_priv *priv = to_ra_ptp_priv(ptp);
-	unsigned long flags;
+	u64 latch_ns;
 	int ret;
 	u32 val;
 
-	spin_lock_irqsave(&priv->lock, flags);
+	lockdep_assert_held(&priv->lock);
 
+	/*
+	 * The clock is latched by the read command, so only the command
+	 * itself is bracketed by the system timestamps. The status read
+	 * flushes the posted write before the post timestamp is taken.
+	 */
+	ptp_read_system_prets(sts);
 	ra_ptp_cmd(priv, RA_PTP_CMD_READ_CLOCK);
+	val = ra_ptp_ior(priv, RA_PTP_STATUS);
+	ptp_read_system_postts(sts);
+
+	latch_ns = ktime_get_raw_fast_ns();
 
 	ret = read_poll_timeout_atomic(ra_ptp_ior, val,
 				       val & RA_PTP_STATUS_READ_CLOCK_VALID,
 				       1, 100, 0, priv, RA_PTP_STATUS);
-	if (ret == 0) {
-		ts->tv_sec = ra_ptp_ior(priv, RA_PTP_READ_TIME_SECONDS_H);
-		ts->tv_sec <<= 32ULL;
-		ts->tv_sec |= ra_ptp_ior(priv, RA_PTP_READ_TIME_SECONDS);
-		ts->tv_nsec = ra_ptp_ior(priv, RA_PTP_READ_TIME_NANOSECONDS);
-	} else {
+	if (ret < 0) {
 		dev_err(priv->dev, "Timeout waiting for clock validity\n");
+		return ret;
 	}
 
+	ra_ptp_hist_add(&priv->latch_delay, ktime_get_raw_fast_ns() - latch_ns);
+
+	ts->tv_sec = ra_ptp_ior(priv, RA_PTP_READ_TIME_SECONDS_H);
+	ts->tv_sec <<= 32ULL;
+	ts->tv_sec |= ra_ptp_ior(priv, RA_PTP_READ_TIME_SECONDS);
+	ts->tv_nsec = ra_ptp_ior(priv, RA_PTP_READ_TIME_NANOSECONDS);
+
+	if (raw_ns)
+		*raw_ns = latch_ns;
+
+	return 0;
+}
+
+static int ra_ptp_gettimex(struct ptp_clock_info *ptp, struct timespec64 *ts,
+			   struct ptp_system_timestamp *sts)
+{
+	struct ra_ptp_priv *priv = to_ra_ptp_priv(ptp);
+	unsigned long flags;
+	int ret;
+
+	/* Plain clock_gettime() callers can be served from the timebase */
+	if (!sts && READ_ONCE(priv->fast_gettime) &&
+	    ra_ptp_timebase_read(priv, ts) == 0)
+		return 0;
+
+	spin_lock_irqsave(&priv->lock, flags);
+	ret = __ra_ptp_read_clock(priv, ts, sts, NULL);
 	spin_unlock_irqrestore(&priv->lock, flags);
 
 	dev_dbg(priv->dev, "%s() tv_sec %lld tv_nsec %ld, ret %d\n",
@@ -166,6 +298,19 @@ static int ra_ptp_gettime(struct ptp_clock_info *ptp, struct timespec64 *ts)
 	return ret;
 }
 
+static int ra_ptp_gettime(struct ptp_clock_info *ptp, struct timespec64 *ts)
+{
+	struct ra_ptp_priv *priv = to_ra_ptp_priv(ptp);
+	unsigned long flags;
+	int ret;
+
+	spin_lock_irqsave(&priv->lock, flags);
+	ret = __ra_ptp_read_clock(priv, ts, NULL, NULL);
+	spin_unlock_irqrestore(&priv->lock, flags);
+
+	return ret;
+}
+
 static int ra_ptp_settime(struct ptp_clock_info *ptp,
 			  const struct timespec64 *ts)
 {
@@ -175,16 +320,116 @@ static int ra_ptp_settime(struct ptp_clock_info *ptp,
 	dev_dbg(priv->dev, "%s() tv_sec %lld tv_nsec %ld\n",
 		__func__, ts->tv_sec, ts->tv_nsec);
 
+	ra_ptp_monitor_log(priv, RA_PTP_SERVO_SETTIME, timespec64_to_ns(ts));
+
 	spin_lock_irqsave(&priv->lock, flags);
 	ra_ptp_iow(priv, RA_PTP_SET_TIME_SECONDS_H, ts->tv_sec >> 32ULL);
 	ra_ptp_iow(priv, RA_PTP_SET_TIME_SECONDS, ts->tv_sec);
 	ra_ptp_iow(priv, RA_PTP_SET_TIME_NANOSECONDS, ts->tv_nsec);
 	ra_ptp_cmd(priv, RA_PTP_CMD_WRITE_CLOCK);
+	ra_ptp_timebase_invalidate(priv);
+	priv->phase.remaining = 0;
+	spin_unlock_irqrestore(&priv->lock, flags);
+
+	return 0;
+}
+
+/* Called with priv->lock held, |delta| must not exceed RA_PTP_ADJ_TIME_MAX_OFFSET */
+static void ra_ptp_apply_offset(struct ra_ptp_priv *priv, s64 delta)
+{
+	u32 val = 0;
+
+	ra_ptp_timebase_step(priv, delta);
+
+	if (delta < 0) {
+		delta = -delta;
+		val |= RA_PTP_OFFSET_CORRECTION_NEGATIVE;
+	}
+
+	val |= delta & RA_PTP_OFFSET_CORRECTION_NS_VALUE_MASK;
+
+	ra_ptp_iow(priv, RA_PTP_OFFSET_CORRECTION, val);
+	ra_ptp_cmd(priv, RA_PTP_CMD_APPLY_CLOCK_OFFSET);
+}
+
+/*
+ * adjphase is not a continuous slew: the hardware has a single drift
+ * register, shared with adjfine and its dither, so the offset is applied
+ * as a series of phase steps of at most RA_PTP_ADJ_PHASE_STEP_NS every
+ * RA_PTP_ADJ_PHASE_PERIOD_NS. Every step restarts the rate measurement of
+ * the software timebase, so no new rate is measured while an adjphase is
+ * pending; the previous rate stays in use.
+ */
+static enum hrtimer_restart ra_ptp_phase_timer(struct hrtimer *timer)
+{
+	struct ra_ptp_priv *priv =
+		container_of(timer, struct ra_ptp_priv, phase.timer);
+	unsigned long flags;
+	bool restart;
+	s64 step;
+
+	spin_lock_irqsave(&priv->lock, flags);
+
+	step = clamp_t(s64, priv->phase.remaining,
+		       -RA_PTP_ADJ_PHASE_STEP_NS, RA_PTP_ADJ_PHASE_STEP_NS);
+	if (step) {
+		ra_ptp_apply_offset(priv, step);
+		priv->phase.remaining -= step;
+	}
+
+	/* Decided under the lock, see ra_ptp_dither_timer() */
+	restart = priv->phase.remaining != 0;
+	if (restart)
+		hrtimer_forward_now(timer, ns_to_ktime(RA_PTP_ADJ_PHASE_PERIOD_NS));
+	else
+		priv->phase.running = false;
+
+	spin_unlock_irqrestore(&priv->lock, flags);
+
+	return restart ? HRTIMER_RESTART : HRTIMER_NORESTART;
+}
+
+static void ra_ptp_phase_cancel(void *data)
+{
+	struct ra_ptp_priv *priv = data;
+	unsigned long flags;
+
+	hrtimer_cancel(&priv->phase.timer);
+
+	spin_lock_irqsave(&priv->lock, flags);
+	priv->phase.running = false;
+	spin_unlock_irqrestore(&priv->lock, flags);
+}
+
+static int ra_ptp_adjphase(struct ptp_clock_info *ptp, s32 offset)
+{
+	struct ra_ptp_priv *priv = to_ra_ptp_priv(ptp);
+	unsigned long flags;
+
+	dev_dbg(priv->dev, "%s() offset %d\n", __func__, offset);
+
+	ra_ptp_monitor_log(priv, RA_PTP_SERVO_ADJPHASE, offset);
+
+	/* A new request replaces the part of the previous one not yet applied */
+	spin_lock_irqsave(&priv->lock, flags);
+
+	priv->phase.remaining = offset;
+
+	if (offset && !priv->phase.running) {
+		priv->phase.running = true;
+		hrtimer_start(&priv->phase.timer, 0, HRTIMER_MODE_REL);
+	}
+
 	spin_unlock_irqrestore(&priv->lock, flags);
 
 	return 0;
 }
 
+static s32 ra_ptp_getmaxphase(struct ptp_clock_info *ptp)
+{
+	return RA_PTP_ADJ_PHASE_MAX_NS;
+}
+
 static int ra_ptp_adjtime(struct ptp_clock_info *ptp, s64 delta)
 {
 	struct ra_ptp_priv *priv = to_ra_ptp_priv(ptp);
@@ -192,35 +437,57 @@ static int ra_ptp_adjtime(struct ptp_clock_info *ptp, s64 delta)
 	struct timespec64 ts;
 	unsigned long flags;
 	int sign = 1, ret, res;
-	u32 val = 0;
 
 	dev_dbg(dev, "%s() delta %lld\n", __func__, delta);
 
 	if (delta == 0)
 		return 0;
 
-	if (delta < 0) {
-		delta *= -1;
-		sign = -1;
-		val |= RA_PTP_OFFSET_CORRECTION_NEGATIVE;
-	}
-
-	if (delta <= RA_PTP_ADJ_TIME_MAX_OFFSET) {
-		val |= delta;
+	ra_ptp_monitor_log(priv, RA_PTP_SERVO_ADJTIME, delta);
 
-		spin_lock_irqsave(&priv->lock, flags);
-		ra_ptp_iow(priv, RA_PTP_OFFSET_CORRECTION, val);
-		ra_ptp_cmd(priv, RA_PTP_CMD_APPLY_CLOCK_OFFSET);
-		spin_unlock_irqrestore(&priv->lock, flags);
-
-		dev_dbg(dev, "%s(): PTP hw clock adjust: %c%lld ns (0x%02x)\n",
-			__func__, (sign > 0) ? '+': '-', delta, val);
+	/*
+	 * Offsets the hardware cannot apply at once are split into several
+	 * corrections, which unlike settime do not lose the time between
+	 * reading and writing the clock.
+	 *
+	 * The offset command has no completion status and the correction
+	 * register is not queued, so each step is flushed with a status read
+	 * and given time to be picked up by the clock before the register is
+	 * written again. RA_PTP_ADJ_TIME_STEP_SETTLE_US is not derived from
+	 * the FPGA timing, which does not document how long the command
+	 * takes; it is a conservative guess that has not been verified.
+	 */
+	if (abs(delta) <= RA_PTP_ADJ_TIME_SPLIT_MAX_NS) {
+		while (delta) {
+			s64 step = clamp_t(s64, delta,
+					   -RA_PTP_ADJ_TIME_MAX_OFFSET,
+					   RA_PTP_ADJ_TIME_MAX_OFFSET);
+
+			spin_lock_irqsave(&priv->lock, flags);
+
+			/* The phase reference has moved, drop any pending adjphase */
+			priv->phase.remaining = 0;
+
+			ra_ptp_apply_offset(priv, step);
+			ra_ptp_ior(priv, RA_PTP_STATUS);
+
+			spin_unlock_irqrestore(&priv->lock, flags);
+
+			delta -= step;
+			if (delta)
+				udelay(RA_PTP_ADJ_TIME_STEP_SETTLE_US);
+		}
 
 		return 0;
 	}
 
 	dev_info(dev, "PTP hw clock adjust: max. offset exceeded, using settime\n");
 
+	if (delta < 0) {
+		delta *= -1;
+		sign = -1;
+	}
+
 	ret = ra_ptp_gettime(ptp, &ts);
 	if (ret < 0) {
 		dev_err(dev, "%s(): PTP clock gettime failed: %d",
@@ -247,13 +514,109 @@ static int ra_ptp_adjtime(struct ptp_clock_info *ptp, s64 delta)
 	return 0;
 }
 
+/*
+ * Find the first edge of a periodic output that is far enough in the
+ * future to be programmed safely. With PTP_PEROUT_PHASE, edges are at
+ * multiples of the period plus the phase, otherwise the requested start
+ * is moved forward by whole periods if it has already passed.
+ */
+static int ra_ptp_perout_start(struct ra_ptp_priv *priv,
+			       const struct ptp_perout_request *req,
+			       u64 period, struct timespec64 *start)
+{
+	struct timespec64 now;
+	u64 now_ns, start_ns, k;
+	int ret;
+
+	ret = ra_ptp_gettime(&priv->ptp_clock_info, &now);
+	if (ret < 0)
+		return ret;
+
+	now_ns = timespec64_to_ns(&now) + RA_EVENT_OUT_MIN_LEAD;
+
+	if (req->flags & PTP_PEROUT_PHASE) {
+		u64 phase = req->phase.sec * NSEC_PER_SEC + req->phase.nsec;
+
+		if (phase >= period)
+			return -ERANGE;
+
+		k = div64_u64(now_ns - phase + period - 1, period);
+		start_ns = k * period + phase;
+	} else {
+		start_ns = req->start.sec * NSEC_PER_SEC + req->start.nsec;
+
+		if (start_ns < now_ns) {
+			k = div64_u64(now_ns - start_ns + period - 1, period);
+			start_ns += k * period;
+		}
+	}
+
+	*start = ns_to_timespec64(start_ns);
+
+	return 0;
+}
+
+static int ra_ptp_enable_per_out(struct ra_ptp_priv *priv,
+				 const struct ptp_perout_request *req, int on)
+{
+	struct device *dev = priv->dev;
+	struct timespec64 start;
+	s64 width = -1;
+	u64 period;
+	int ret;
+
+	if (req->index != 0) {
+		dev_err(dev, "%s(): invalid index %d for PEROUT\n",
+			__func__, req->index);
+		return -EINVAL;
+	}
+
+	if (req->flags & ~(PTP_PEROUT_DUTY_CYCLE | PTP_PEROUT_PHASE))
+		return -EOPNOTSUPP;
+
+	if (!on)
+		return ra_ptp_set_per_out(priv, 0, NULL, -1);
+
+	period = req->period.sec * NSEC_PER_SEC + req->period.nsec;
+	if (period == 0)
+		return -EINVAL;
+
+	if (req->flags & PTP_PEROUT_DUTY_CYCLE)
+		width = req->on.sec * NSEC_PER_SEC + req->on.nsec;
+
+	ret = ra_ptp_perout_start(priv, req, period, &start);
+	if (ret < 0)
+		return ret;
+
+	return ra_ptp_set_per_out(priv, period, &start, width);
+}
+
+static int ra_ptp_verify(struct ptp_clock_info *ptp, unsigned int pin,
+			 enum ptp_pin_function func, unsigned int chan)
+{
+	/* The pins have fixed functions, they can only be switched off */
+	if (func == PTP_PF_NONE)
+		return 0;
+
+	if (chan != 0)
+		return -EINVAL;
+
+	switch (pin) {
+	case RA_PTP_PIN_EXTTS:
+		return func == PTP_PF_EXTTS ? 0 : -EOPNOTSUPP;
+	case RA_PTP_PIN_PEROUT:
+		return func == PTP_PF_PEROUT ? 0 : -EOPNOTSUPP;
+	}
+
+	return -EINVAL;
+}
+
 static int ra_ptp_enable(struct ptp_clock_info *ptp,
 			 struct ptp_clock_request *rq,
 			 int on)
 {
 	struct ra_ptp_priv *priv = to_ra_ptp_priv(ptp);
 	struct device *dev = priv->dev;
-	unsigned int ns = 0;
 
 	dev_dbg(dev, "%s()\n", __func__);
 
@@ -277,17 +640,7 @@ static int ra_ptp_enable(struct ptp_clock_info *ptp,
 		return 0;
 
 	case PTP_CLK_REQ_PEROUT:
-		if (rq->perout.index != 0) {
-			dev_err(dev, "%s(): invalid index %d for PEROUT\n",
-				__func__, rq->perout.index);
-			return -EINVAL;
-		}
-
-		if (on)
-			ns = rq->perout.period.sec * NSEC_PER_SEC +
-			     rq->perout.period.nsec;
-
-		return ra_ptp_set_per_out(priv, ns);
+		return ra_ptp_enable_per_out(priv, &rq->perout, on);
 
 	case PTP_CLK_REQ_PPS:
 		ra_ptp_write_mask(priv, RA_PTP_IRQ_DISABLE,
@@ -308,94 +661,31 @@ static int ra_ptp_enable(struct ptp_clock_info *ptp,
 
 /* Interrupt handlers */
 
-static void ra_ptp_extts_irq(struct ra_ptp_priv *priv)
-{
-	struct device *dev = priv->dev;
-	u32 ts_cnt;
-
-	spin_lock(&priv->lock);
-
-	ts_cnt = ra_ptp_ior(priv, RA_PTP_EXTTS_TS_CNT);
-	dev_dbg(dev, "%s() ts_cnt %d\n", __func__, ts_cnt);
-
-	if (ts_cnt >= RA_PTP_EXTTS_MAX_TS_CNT) {
-		u32 status = ra_ptp_ior(priv, RA_PTP_STATUS);
-		if (status & RA_PTP_STATUS_EXTTS_FIFO_OVFLW) {
-			dev_err(dev, "PTP hw clock: event timestamp FIFO overflow!"
-				" => Event timestamp(s) may be lost or damaged\n");
-			ra_ptp_cmd(priv, RA_PTP_CMD_RESET_EXTTS_FIFO_OVFLW);
-		}
-	}
-
-	while (ts_cnt--) {
-		struct ra_ptp_extts_fpga_timestamp extts;
-		struct ptp_clock_event event = {
-			.type = PTP_CLOCK_EXTTS,
-		};
-		u32 sot, ctr;
-		u64 seconds;
-
-		ctr = RA_PTP_EXTTS_TIMESTAMP_WORDLEN;
-
-		do {
-			sot = ra_ptp_ior(priv, RA_PTP_EXTTS_DATA);
-			dev_dbg(dev, "%s(): sot: 0x%04X\n", __func__, sot);
-		} while (((sot >> 16) != RA_PTP_EXTTS_START_OF_TS) && --ctr);
-
-		if (ctr) {
-			extts.seconds_hi = sot & 0xffff;
-			ra_ptp_ior_rep(priv, RA_PTP_EXTTS_DATA, &extts.seconds,
-				       sizeof(extts) - sizeof(u32));
-
-			seconds =  (u64)extts.seconds_hi << 32ULL;
-			seconds += (u64)extts.seconds;
-
-			event.timestamp =  seconds * NSEC_PER_SEC;
-			event.timestamp += (u64)extts.nanoseconds;
-
-			priv->last_ptp_timestamp = event.timestamp;
-			priv->last_rtp_timestamp = extts.rtp_ts;
-
-			dev_dbg(dev, "%s(): event TS %lld\n",
-				__func__, event.timestamp);
-
-			ptp_clock_event(priv->ptp_clock, &event);
-		} else {
-			dev_dbg(dev, "%s: no start of timestamp found\n",
-				__func__);
-		}
-	}
-
-	spin_unlock(&priv->lock);
-}
-
 static void ra_ptp_pps_irq(struct ra_ptp_priv *priv)
 {
-	struct ptp_clock_event event;
+	struct ptp_clock_event event = {
+		.type = PTP_CLOCK_PPSUSR,
+	};
 	struct timespec64 ts;
-	int ret;
+	bool valid;
 
 	dev_dbg(priv->dev, "%s()\n", __func__);
 
-	ra_ptp_cmd(priv, RA_PTP_CMD_ACK_PPS_IRQ);
-
 	/*
-	* Assuming that the PPS IRQ is directly related to the start
-	* of a second:
-	* read the ptp clock and use only the seconds part to provide
-	* the exact time at the rising edge of the PPS pulse
-	*/
+	 * The PPS IRQ is raised at the start of a second of the PTP clock.
+	 * How far the PTP clock has advanced past that edge is the interrupt
+	 * latency, which is taken off the system timestamp, so the event
+	 * carries the system time of the edge itself. The timebase is used
+	 * for that, as latching the clock would busy-wait in IRQ context.
+	 * Without a valid timebase, the uncorrected timestamp is reported.
+	 */
+	pps_get_ts(&event.pps_times);
+	valid = ra_ptp_timebase_read(priv, &ts) == 0;
 
-	ret = ra_ptp_gettime(&priv->ptp_clock_info, &ts);
-	if (ret < 0) {
-		dev_err(priv->dev, "%s(): ra_ptp_gettime() failed: %d\n",
-			__func__, ret);
-		return;
-	}
+	ra_ptp_cmd(priv, RA_PTP_CMD_ACK_PPS_IRQ);
 
-	event.type = PTP_CLOCK_PPSUSR;
-	event.pps_times.ts_real.tv_sec = ts.tv_sec;
-	event.pps_times.ts_real.tv_nsec	= 0;
+	if (valid && ts.tv_nsec < NSEC_PER_SEC / 2)
+		pps_sub_ts(&event.pps_times, ns_to_timespec64(ts.tv_nsec));
 
 	ptp_clock_event(priv->ptp_clock, &event);
 }
@@ -404,6 +694,7 @@ static irqreturn_t ra_ptp_irqhandler(int irq, void *devid)
 {
 	struct ra_ptp_priv *priv = devid;
 	irqreturn_t ret = IRQ_NONE;
+	bool wake = false;
 
 	dev_dbg(priv->dev, "%s()\n", __func__);
 
@@ -417,7 +708,8 @@ static irqreturn_t ra_ptp_irqhandler(int irq, void *devid)
 			break;
 
 		if (irqs & RA_PTP_IRQ_EXTTS) {
-			ra_ptp_extts_irq(priv);
+			if (ra_ptp_extts_drain(priv))
+				wake = true;
 			ret = IRQ_HANDLED;
 		}
 
@@ -427,7 +719,16 @@ static irqreturn_t ra_ptp_irqhandler(int irq, void *devid)
 		}
 	}
 
-	return ret;
+	return wake ? IRQ_WAKE_THREAD : ret;
+}
+
+static irqreturn_t ra_ptp_irq_thread(int irq, void *devid)
+{
+	struct ra_ptp_priv *priv = devid;
+
+	ra_ptp_extts_process(priv);
+
+	return IRQ_HANDLED;
 }
 
 /* sysfs */
@@ -451,8 +752,77 @@ static ssize_t rtp_timestamp_show(struct device *dev,
 }
 static DEVICE_ATTR_RO(rtp_timestamp);
 
+static ssize_t fast_gettime_show(struct device *dev,
+				 struct device_attribute *attr,
+				 char *buf)
+{
+	struct ra_ptp_priv *priv = dev->platform_data;
+
+	return sysfs_emit(buf, "%d\n", READ_ONCE(priv->fast_gettime));
+}
+
+static ssize_t fast_gettime_store(struct device *dev,
+				  struct device_attribute *attr,
+				  const char *buf, size_t count)
+{
+	struct ra_ptp_priv *priv = dev->platform_data;
+	bool val;
+	int ret;
+
+	ret = kstrtobool(buf, &val);
+	if (ret < 0)
+		return ret;
+
+	WRITE_ONCE(priv->fast_gettime, val);
+
+	return count;
+}
+static DEVICE_ATTR_RW(fast_gettime);
+
+static ssize_t adjfine_dither_show(struct device *dev,
+				   struct device_attribute *attr,
+				   char *buf)
+{
+	struct ra_ptp_priv *priv = dev->platform_data;
+
+	return sysfs_emit(buf, "%d\n", READ_ONCE(priv->dither.enable));
+}
+
+static ssize_t adjfine_dither_store(struct device *dev,
+				    struct device_attribute *attr,
+				    const char *buf, size_t count)
+{
+	struct ra_ptp_priv *priv = dev->platform_data;
+	unsigned long flags;
+	bool val;
+	int ret;
+
+	ret = kstrtobool(buf, &val);
+	if (ret < 0)
+		return ret;
+
+	spin_lock_irqsave(&priv->lock, flags);
+
+	if (val != priv->dither.enable) {
+		/* Continue from the currently programmed integer value */
+		priv->dither.target = (s64)priv->drift_ppb << RA_PTP_DITHER_FRAC_BITS;
+		priv->dither.acc = 0;
+		priv->dither.enable = val;
+	}
+
+	spin_unlock_irqrestore(&priv->lock, flags);
+
+	if (!val)
+		ra_ptp_dither_stop(priv);
+
+	return count;
+}
+static DEVICE_ATTR_RW(adjfine_dither);
+
 static struct attribute *ra_ptp_attrs[] = {
 	&dev_attr_rtp_timestamp.attr,
+	&dev_attr_fast_gettime.attr,
+	&dev_attr_adjfine_dither.attr,
 	NULL
 };
 
@@ -484,6 +854,15 @@ static int ra_ptp_probe(struct platform_device *pdev)
 		return -ENOMEM;
 
 	spin_lock_init(&priv->lock);
+	spin_lock_init(&priv->extts.lock);
+	INIT_KFIFO(priv->extts.words);
+	INIT_LIST_HEAD(&priv->extts.readers);
+	init_waitqueue_head(&priv->extts.wait);
+	ra_ptp_timebase_init(priv);
+	hrtimer_init(&priv->dither.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	priv->dither.timer.function = ra_ptp_dither_timer;
+	hrtimer_init(&priv->phase.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	priv->phase.timer.function = ra_ptp_phase_timer;
 	dev_set_drvdata(dev, priv);
 	dev->platform_data = priv;
 	priv->dev = dev;
@@ -500,13 +879,22 @@ static int ra_ptp_probe(struct platform_device *pdev)
 	}
 
 	irq = of_irq_get(node, 0);
-	ret = devm_request_irq(dev, irq, ra_ptp_irqhandler, IRQF_SHARED,
-			       dev_name(dev), priv);
+	ret = devm_request_threaded_irq(dev, irq, ra_ptp_irqhandler,
+					ra_ptp_irq_thread, IRQF_SHARED,
+					dev_name(dev), priv);
 	if (ret < 0) {
 		dev_err(dev, "could not map Ravenna sync IRQ\n");
 		return ret;
 	}
 
+	ret = devm_add_action_or_reset(dev, ra_ptp_dither_cancel, priv);
+	if (ret < 0)
+		return ret;
+
+	ret = devm_add_action_or_reset(dev, ra_ptp_phase_cancel, priv);
+	if (ret < 0)
+		return ret;
+
 	ret = devm_device_add_groups(dev, ra_ptp_groups);
 	if (ret < 0)
 		return ret;
@@ -514,20 +902,41 @@ static int ra_ptp_probe(struct platform_device *pdev)
 	priv->ptp_clock_info.max_adj	= RA_PTP_DRIFT_CORRECTION_MAX_PPB;
 	priv->ptp_clock_info.n_ext_ts	= RA_PTP_EXTTS_CNT;
 	priv->ptp_clock_info.n_per_out	= RA_PTP_PEROUT_CNT;
+	priv->ptp_clock_info.n_pins	= RA_PTP_PIN_CNT;
+	priv->ptp_clock_info.pin_config	= priv->pins;
+	priv->ptp_clock_info.verify	= ra_ptp_verify;
 	priv->ptp_clock_info.adjfine	= ra_ptp_adjfine;
 	priv->ptp_clock_info.adjtime	= ra_ptp_adjtime;
+	priv->ptp_clock_info.adjphase	= ra_ptp_adjphase;
+	priv->ptp_clock_info.getmaxphase = ra_ptp_getmaxphase;
 	priv->ptp_clock_info.gettime64	= ra_ptp_gettime;
+	priv->ptp_clock_info.gettimex64	= ra_ptp_gettimex;
 	priv->ptp_clock_info.settime64	= ra_ptp_settime;
 	priv->ptp_clock_info.enable	= ra_ptp_enable;
+	priv->ptp_clock_info.do_aux_work = ra_ptp_timebase_work;
 	priv->ptp_clock_info.owner	= THIS_MODULE;
 	strlcpy(priv->ptp_clock_info.name, "ravenna_ptp",
 		sizeof(priv->ptp_clock_info.name)-1);
 
+	strscpy(priv->pins[RA_PTP_PIN_EXTTS].name, "extts0",
+		sizeof(priv->pins[RA_PTP_PIN_EXTTS].name));
+	priv->pins[RA_PTP_PIN_EXTTS].index = RA_PTP_PIN_EXTTS;
+	priv->pins[RA_PTP_PIN_EXTTS].func = PTP_PF_EXTTS;
+
+	strscpy(priv->pins[RA_PTP_PIN_PEROUT].name, "perout0",
+		sizeof(priv->pins[RA_PTP_PIN_PEROUT].name));
+	priv->pins[RA_PTP_PIN_PEROUT].index = RA_PTP_PIN_PEROUT;
+	priv->pins[RA_PTP_PIN_PEROUT].func = PTP_PF_PEROUT;
+
 	if (id & RA_PTP_ID_PPS_AVAILABLE)
 		priv->ptp_clock_info.pps = 1;
 	else
 		dev_info(dev, "Device does not support PPS\n");
 
+	ret = ra_ptp_monitor_init(priv);
+	if (ret < 0)
+		return ret;
+
 	priv->ptp_clock = ptp_clock_register(&priv->ptp_clock_info, dev);
 	if (IS_ERR(priv->ptp_clock))
 		return PTR_ERR(priv->ptp_clock);
@@ -537,15 +946,25 @@ static int ra_ptp_probe(struct platform_device *pdev)
 	if (ret < 0)
 		return ret;
 
+	ptp_schedule_worker(priv->ptp_clock, 0);
+
 	/* The ethernet driver will access the PTP clock through the driver-data */
 	platform_set_drvdata(pdev, priv->ptp_clock);
 
 	dev_info(dev, "Ravenna PTP, clock index %d\n",
 		 ptp_clock_index(priv->ptp_clock));
 
+	ret = ra_ptp_extts_init(priv);
+	if (ret < 0)
+		return ret;
+
+	ret = ra_ptp_debugfs_init(priv);
+	if (ret < 0)
+		return ret;
+
 	of_property_read_u32(node, "lawo,periodic-output-interval-ns",
 			     &per_out_interval);
-	ra_ptp_set_per_out(priv, per_out_interval);
+	ra_ptp_set_per_out(priv, per_out_interval, NULL, -1);
 
 	return 0;
 }
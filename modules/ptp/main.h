@@ -0,0 +1,201 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef RA_PTP_MAIN_H
+#define RA_PTP_MAIN_H
+
+#include <linux/hrtimer.h>
+#include <linux/io.h>
+#include <linux/kfifo.h>
+#include <linux/log2.h>
+#include <linux/miscdevice.h>
+#include <linux/ptp_clock_kernel.h>
+#include <linux/seqlock.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+#include <uapi/ravenna/ptp.h>
+
+#include "regs.h"
+
+#define RA_PTP_HIST_BUCKETS	32
+
+struct ra_ptp_hist {
+	u64 buckets[RA_PTP_HIST_BUCKETS];
+};
+
+#define RA_PTP_TIMEBASE_PERIOD		msecs_to_jiffies(100)
+/* samples older than this are not extrapolated from */
+#define RA_PTP_TIMEBASE_MAX_AGE_NS	(1 * NSEC_PER_SEC)
+
+/*
+ * Software timebase: the hardware clock sampled against CLOCK_MONOTONIC_RAW,
+ * plus the rate of the hardware clock relative to it. Readers extrapolate
+ * from the last sample without touching the hardware.
+ */
+struct ra_ptp_timebase {
+	seqcount_spinlock_t	seq;
+	bool			valid;
+	u64			phc_ns;
+	u64			raw_ns;
+	s64			rate_ppb;
+
+	/* writer side, under priv->lock */
+	bool			rate_valid;
+	s32			adj_ppb;
+	s64			last_err_ns;
+	u64			max_err_ns;
+	u64			samples;
+};
+
+#define RA_PTP_DITHER_PERIOD_NS		(10 * NSEC_PER_MSEC)
+#define RA_PTP_DITHER_FRAC_BITS		16
+
+/*
+ * Sub-ppb frequency adjustment: the drift correction register only takes
+ * integer ppb, so it is toggled between the two neighbouring values such
+ * that the mean over time matches the requested frequency.
+ */
+struct ra_ptp_dither {
+	struct hrtimer		timer;
+	bool			running;
+	bool			enable;
+	s64			target;	/* ppb, RA_PTP_DITHER_FRAC_BITS fraction */
+	s64			acc;
+};
+
+/* adjphase: the offset is applied in bounded steps from a timer */
+struct ra_ptp_phase {
+	struct hrtimer		timer;
+	bool			running;
+	s64			remaining;
+};
+
+#define RA_PTP_EXTTS_EVENT_WORDS \
+	(sizeof(struct ra_ptp_extts_fpga_timestamp) / sizeof(u32))
+#define RA_PTP_EXTTS_RING_WORDS		4096
+
+/*
+ * External timestamps: the hard IRQ handler moves the raw words out of
+ * the small hardware FIFO into a ring, the IRQ thread parses them and
+ * hands the pairs to the /dev/ptp<N>-extts readers.
+ */
+struct ra_ptp_extts {
+	DECLARE_KFIFO(words, u32, RA_PTP_EXTTS_RING_WORDS);
+	u64			ring_overflows;	/* words, hard IRQ only */
+	u64			misaligned;	/* words, IRQ thread only */
+
+	struct miscdevice	misc;
+	spinlock_t		lock;
+	struct list_head	readers;
+	wait_queue_head_t	wait;
+	u32			seq;
+	u64			events;
+	u64			hw_overflows;
+};
+
+#define RA_PTP_MONITOR_LOG_SIZE		512
+#define RA_PTP_MONITOR_PHASE_SIZE	1024
+
+struct ra_ptp_monitor {
+	spinlock_t			lock;
+
+	struct ra_ptp_servo_event	log[RA_PTP_MONITOR_LOG_SIZE];
+	unsigned int			log_head;
+	unsigned int			log_count;
+	u64				calls[RA_PTP_SERVO_SETTIME + 1];
+	u64				step_sum;
+	u64				step_max;
+
+	/* reference phase in ns, one sample per EXTTS event */
+	s64				phase[RA_PTP_MONITOR_PHASE_SIZE];
+	unsigned int			phase_head;
+	unsigned int			phase_count;
+	u64				phase_resets;
+	u64				last_extts_ns;
+	u64				tau0_ns;
+};
+
+struct ra_ptp_priv {
+	struct device		*dev;
+	void __iomem		*regs;
+	struct ptp_clock	*ptp_clock;
+	struct ptp_clock_info	ptp_clock_info;
+	struct ptp_pin_desc	pins[RA_PTP_PIN_CNT];
+	u64			last_ptp_timestamp;
+	u32			last_rtp_timestamp;
+	spinlock_t		lock;
+
+	/* time from the read clock command to the valid flag, under lock */
+	struct ra_ptp_hist	latch_delay;
+
+	struct ra_ptp_timebase	tb;
+	bool			fast_gettime;
+
+	struct ra_ptp_dither	dither;
+	s32			drift_ppb;
+
+	struct ra_ptp_phase	phase;
+
+	struct ra_ptp_extts	extts;
+
+	struct ra_ptp_monitor	*monitor;
+
+	struct dentry		*debugfs;
+};
+
+static inline u32 ra_ptp_ior(struct ra_ptp_priv *priv, off_t reg)
+{
+	return ioread32(priv->regs + reg);
+}
+
+static inline void ra_ptp_ior_rep(struct ra_ptp_priv *priv, off_t reg,
+				  void *dst, size_t len)
+{
+	ioread32_rep(priv->regs + reg, dst, len / sizeof(u32));
+}
+
+static inline void ra_ptp_iow(struct ra_ptp_priv *priv, off_t reg, u32 val)
+{
+	iowrite32(val, priv->regs + reg);
+}
+
+static inline void ra_ptp_cmd(struct ra_ptp_priv *priv, u32 cmd)
+{
+	ra_ptp_iow(priv, RA_PTP_CMD, cmd);
+}
+
+#define to_ra_ptp_priv(ptp) \
+	container_of(ptp, struct ra_ptp_priv, ptp_clock_info)
+
+static inline void ra_ptp_hist_add(struct ra_ptp_hist *h, u64 v)
+{
+	unsigned int i = 0;
+
+	if (v)
+		i = min_t(unsigned int, ilog2(v) + 1, RA_PTP_HIST_BUCKETS - 1);
+
+	h->buckets[i]++;
+}
+
+int __ra_ptp_read_clock(struct ra_ptp_priv *priv, struct timespec64 *ts,
+			struct ptp_system_timestamp *sts, u64 *raw_ns);
+
+void ra_ptp_timebase_init(struct ra_ptp_priv *priv);
+long ra_ptp_timebase_work(struct ptp_clock_info *ptp);
+int ra_ptp_timebase_read(struct ra_ptp_priv *priv, struct timespec64 *ts);
+void ra_ptp_timebase_set_rate(struct ra_ptp_priv *priv, s32 adj_ppb);
+void ra_ptp_timebase_step(struct ra_ptp_priv *priv, s64 delta);
+void ra_ptp_timebase_invalidate(struct ra_ptp_priv *priv);
+
+int ra_ptp_extts_init(struct ra_ptp_priv *priv);
+bool ra_ptp_extts_drain(struct ra_ptp_priv *priv);
+void ra_ptp_extts_process(struct ra_ptp_priv *priv);
+
+int ra_ptp_monitor_init(struct ra_ptp_priv *priv);
+void ra_ptp_monitor_log(struct ra_ptp_priv *priv, u32 type, s64 value);
+void ra_ptp_monitor_extts(struct ra_ptp_priv *priv, u64 ts_ns);
+void ra_ptp_monitor_debugfs_init(struct ra_ptp_priv *priv, struct dentry *root);
+
+int ra_ptp_debugfs_init(struct ra_ptp_priv *priv);
+
+#endif /* RA_PTP_MAIN_H */
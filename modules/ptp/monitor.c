@@ -0,0 +1,392 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <linux/debugfs.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/timekeeping.h>
+
+#include "main.h"
+
+/*
+ * PTP clock stability monitor: a log of how the clock is being steered,
+ * and the phase of an external reference captured through EXTTS, from
+ * which the Allan deviation of the clock is derived.
+ */
+
+static const char * const ra_ptp_servo_names[] = {
+	[RA_PTP_SERVO_ADJFINE]	= "adjfine",
+	[RA_PTP_SERVO_ADJTIME]	= "adjtime",
+	[RA_PTP_SERVO_ADJPHASE]	= "adjphase",
+	[RA_PTP_SERVO_SETTIME]	= "settime",
+};
+
+/* scaled_ppm to ppb/1000: 1e6 / 65536 */
+static s64 ra_ptp_scaled_to_mppb(s64 scaled)
+{
+	return div_s64(scaled * 15625, 1024);
+}
+
+void ra_ptp_monitor_log(struct ra_ptp_priv *priv, u32 type, s64 value)
+{
+	struct ra_ptp_monitor *mon = priv->monitor;
+	struct ra_ptp_servo_event *ev;
+	unsigned long flags;
+
+	spin_lock_irqsave(&mon->lock, flags);
+
+	ev = &mon->log[mon->log_head];
+	ev->timestamp_ns = ktime_get_ns();
+	ev->value = value;
+	ev->type = type;
+	ev->reserved = 0;
+
+	mon->log_head = (mon->log_head + 1) % RA_PTP_MONITOR_LOG_SIZE;
+	if (mon->log_count < RA_PTP_MONITOR_LOG_SIZE)
+		mon->log_count++;
+
+	mon->calls[type]++;
+
+	if (type == RA_PTP_SERVO_ADJTIME || type == RA_PTP_SERVO_ADJPHASE) {
+		u64 step = abs(value);
+
+		mon->step_sum += step;
+		mon->step_max = max(mon->step_max, step);
+	}
+
+	spin_unlock_irqrestore(&mon->lock, flags);
+}
+
+static void ra_ptp_monitor_phase_reset(struct ra_ptp_monitor *mon)
+{
+	mon->phase_head = 0;
+	mon->phase_count = 0;
+	mon->last_extts_ns = 0;
+}
+
+void ra_ptp_monitor_extts(struct ra_ptp_priv *priv, u64 ts_ns)
+{
+	struct ra_ptp_monitor *mon = priv->monitor;
+	unsigned long flags;
+	u32 rem;
+	s64 x;
+
+	spin_lock_irqsave(&mon->lock, flags);
+
+	/* A missing or extra edge breaks the sample series, start over */
+	if (mon->last_extts_ns) {
+		s64 d = ts_ns - mon->last_extts_ns - mon->tau0_ns;
+
+		if (abs(d) > (s64)(mon->tau0_ns / 2)) {
+			ra_ptp_monitor_phase_reset(mon);
+			mon->phase_resets++;
+		}
+	}
+
+	mon->last_extts_ns = ts_ns;
+
+	/* Phase of the reference edge relative to the local clock */
+	div_u64_rem(ts_ns, (u32)mon->tau0_ns, &rem);
+	x = rem;
+	if (rem > mon->tau0_ns / 2)
+		x -= (s64)mon->tau0_ns;
+
+	mon->phase[mon->phase_head] = x;
+	mon->phase_head = (mon->phase_head + 1) % RA_PTP_MONITOR_PHASE_SIZE;
+	if (mon->phase_count < RA_PTP_MONITOR_PHASE_SIZE)
+		mon->phase_count++;
+
+	spin_unlock_irqrestore(&mon->lock, flags);
+}
+
+/* Copy the servo log out in chronological order, returns the entry count */
+static unsigned int ra_ptp_monitor_copy_log(struct ra_ptp_monitor *mon,
+					    struct ra_ptp_servo_event *log)
+{
+	unsigned int i, n, first;
+	unsigned long flags;
+
+	spin_lock_irqsave(&mon->lock, flags);
+
+	n = mon->log_count;
+	first = (mon->log_head + RA_PTP_MONITOR_LOG_SIZE - n) %
+		RA_PTP_MONITOR_LOG_SIZE;
+
+	for (i = 0; i < n; i++)
+		log[i] = mon->log[(first + i) % RA_PTP_MONITOR_LOG_SIZE];
+
+	spin_unlock_irqrestore(&mon->lock, flags);
+
+	return n;
+}
+
+static int ra_ptp_servo_log_show(struct seq_file *s, void *p)
+{
+	struct ra_ptp_priv *priv = s->private;
+	struct ra_ptp_servo_event *log;
+	unsigned int i, n;
+
+	log = kmalloc_array(RA_PTP_MONITOR_LOG_SIZE, sizeof(*log), GFP_KERNEL);
+	if (!log)
+		return -ENOMEM;
+
+	n = ra_ptp_monitor_copy_log(priv->monitor, log);
+
+	for (i = 0; i < n; i++) {
+		u32 ns;
+		u64 sec = div_u64_rem(log[i].timestamp_ns, NSEC_PER_SEC, &ns);
+
+		seq_printf(s, "%llu.%09u %-8s %lld\n", sec, ns,
+			   ra_ptp_servo_names[log[i].type], log[i].value);
+	}
+
+	kfree(log);
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(ra_ptp_servo_log);
+
+static int ra_ptp_servo_log_bin_show(struct seq_file *s, void *p)
+{
+	struct ra_ptp_priv *priv = s->private;
+	struct ra_ptp_servo_event *log;
+	unsigned int n;
+
+	log = kmalloc_array(RA_PTP_MONITOR_LOG_SIZE, sizeof(*log), GFP_KERNEL);
+	if (!log)
+		return -ENOMEM;
+
+	n = ra_ptp_monitor_copy_log(priv->monitor, log);
+	seq_write(s, log, n * sizeof(*log));
+
+	kfree(log);
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(ra_ptp_servo_log_bin);
+
+static void ra_ptp_seq_print_mppb(struct seq_file *s, const char *name, s64 v)
+{
+	u32 frac;
+	u64 i = div_u64_rem(abs(v), 1000, &frac);
+
+	seq_printf(s, "%s: %s%llu.%03u ppb\n", name, v < 0 ? "-" : "", i, frac);
+}
+
+static int ra_ptp_servo_stats_show(struct seq_file *s, void *p)
+{
+	struct ra_ptp_priv *priv = s->private;
+	struct ra_ptp_monitor *mon = priv->monitor;
+	u64 calls[ARRAY_SIZE(mon->calls)], step_sum, step_max;
+	struct ra_ptp_servo_event *log;
+	s64 sum = 0, mean;
+	unsigned int i, n, cnt = 0;
+	unsigned long flags;
+	u64 var = 0;
+
+	log = kmalloc_array(RA_PTP_MONITOR_LOG_SIZE, sizeof(*log), GFP_KERNEL);
+	if (!log)
+		return -ENOMEM;
+
+	n = ra_ptp_monitor_copy_log(mon, log);
+
+	spin_lock_irqsave(&mon->lock, flags);
+	memcpy(calls, mon->calls, sizeof(calls));
+	step_sum = mon->step_sum;
+	step_max = mon->step_max;
+	spin_unlock_irqrestore(&mon->lock, flags);
+
+	for (i = 0; i < n; i++) {
+		if (log[i].type != RA_PTP_SERVO_ADJFINE)
+			continue;
+
+		sum += log[i].value;
+		cnt++;
+	}
+
+	seq_printf(s, "Calls: adjfine %llu, adjtime %llu, adjphase %llu, settime %llu\n",
+		   calls[RA_PTP_SERVO_ADJFINE], calls[RA_PTP_SERVO_ADJTIME],
+		   calls[RA_PTP_SERVO_ADJPHASE], calls[RA_PTP_SERVO_SETTIME]);
+	seq_printf(s, "Time offset steps: largest %llu ns, total %llu ns\n",
+		   step_max, step_sum);
+
+	if (cnt) {
+		mean = div_s64(sum, cnt);
+
+		for (i = 0; i < n; i++) {
+			s64 d;
+
+			if (log[i].type != RA_PTP_SERVO_ADJFINE)
+				continue;
+
+			d = log[i].value - mean;
+			var += d * d;
+		}
+
+		var = div_u64(var, cnt);
+
+		seq_printf(s, "Frequency corrections in log: %u\n", cnt);
+		ra_ptp_seq_print_mppb(s, "Frequency correction mean",
+				      ra_ptp_scaled_to_mppb(mean));
+		ra_ptp_seq_print_mppb(s, "Frequency correction std dev",
+				      ra_ptp_scaled_to_mppb(int_sqrt64(var)));
+	}
+
+	kfree(log);
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(ra_ptp_servo_stats);
+
+/*
+ * Overlapping Allan deviation from phase samples x taken every tau0:
+ * adev(n * tau0)^2 = sum((x[i+2n] - 2x[i+n] + x[i])^2) / (2 (N - 2n) (n tau0)^2)
+ */
+static int ra_ptp_adev_show(struct seq_file *s, void *p)
+{
+	struct ra_ptp_priv *priv = s->private;
+	struct ra_ptp_monitor *mon = priv->monitor;
+	unsigned int i, n, cnt, first;
+	unsigned long flags;
+	u64 tau0, resets;
+	s64 *x;
+
+	x = kmalloc_array(RA_PTP_MONITOR_PHASE_SIZE, sizeof(*x), GFP_KERNEL);
+	if (!x)
+		return -ENOMEM;
+
+	spin_lock_irqsave(&mon->lock, flags);
+
+	cnt = mon->phase_count;
+	first = (mon->phase_head + RA_PTP_MONITOR_PHASE_SIZE - cnt) %
+		RA_PTP_MONITOR_PHASE_SIZE;
+
+	for (i = 0; i < cnt; i++)
+		x[i] = mon->phase[(first + i) % RA_PTP_MONITOR_PHASE_SIZE];
+
+	tau0 = mon->tau0_ns;
+	resets = mon->phase_resets;
+
+	spin_unlock_irqrestore(&mon->lock, flags);
+
+	seq_printf(s, "Phase samples: %u, tau0 %llu ns, series restarts %llu\n",
+		   cnt, tau0, resets);
+
+	for (n = 1; 2 * n < cnt; n *= 2) {
+		u64 sum = 0, ms, rms_ps, adev;
+		unsigned int m = cnt - 2 * n;
+
+		for (i = 0; i < m; i++) {
+			u64 d = abs(x[i + 2 * n] - 2 * x[i + n] + x[i]);
+			u64 sq = d > U32_MAX ? U64_MAX / 2 : d * d;
+
+			sum = min_t(u64, sum + sq, U64_MAX / 2);
+		}
+
+		ms = div_u64(sum, 2 * m);
+
+		if (ms <= U64_MAX / USEC_PER_SEC)
+			rms_ps = int_sqrt64(ms * USEC_PER_SEC);
+		else
+			rms_ps = int_sqrt64(ms) * 1000;
+
+		/* in units of 1e-12 */
+		adev = mul_u64_u64_div_u64(rms_ps, NSEC_PER_SEC, n * tau0);
+
+		seq_printf(s, "tau %10llu ns: adev %llu e-12 (%u terms)\n",
+			   n * tau0, adev, m);
+	}
+
+	kfree(x);
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(ra_ptp_adev);
+
+static int ra_ptp_adev_tau0_get(void *data, u64 *val)
+{
+	struct ra_ptp_priv *priv = data;
+
+	*val = READ_ONCE(priv->monitor->tau0_ns);
+
+	return 0;
+}
+
+static int ra_ptp_adev_tau0_set(void *data, u64 val)
+{
+	struct ra_ptp_priv *priv = data;
+	struct ra_ptp_monitor *mon = priv->monitor;
+	unsigned long flags;
+
+	if (val == 0 || val > U32_MAX)
+		return -EINVAL;
+
+	spin_lock_irqsave(&mon->lock, flags);
+	mon->tau0_ns = val;
+	ra_ptp_monitor_phase_reset(mon);
+	spin_unlock_irqrestore(&mon->lock, flags);
+
+	return 0;
+}
+
+DEFINE_DEBUGFS_ATTRIBUTE(ra_ptp_adev_tau0_fops,
+			 ra_ptp_adev_tau0_get, ra_ptp_adev_tau0_set, "%llu\n");
+
+static int ra_ptp_monitor_reset_set(void *data, u64 val)
+{
+	struct ra_ptp_priv *priv = data;
+	struct ra_ptp_monitor *mon = priv->monitor;
+	unsigned long flags;
+
+	spin_lock_irqsave(&mon->lock, flags);
+	mon->log_head = 0;
+	mon->log_count = 0;
+	memset(mon->calls, 0, sizeof(mon->calls));
+	mon->step_sum = 0;
+	mon->step_max = 0;
+	mon->phase_resets = 0;
+	ra_ptp_monitor_phase_reset(mon);
+	spin_unlock_irqrestore(&mon->lock, flags);
+
+	return 0;
+}
+
+DEFINE_DEBUGFS_ATTRIBUTE(ra_ptp_monitor_reset_fops,
+			 NULL, ra_ptp_monitor_reset_set, "%llu\n");
+
+void ra_ptp_monitor_debugfs_init(struct ra_ptp_priv *priv, struct dentry *root)
+{
+	struct dentry *dir = debugfs_create_dir("monitor", root);
+
+	debugfs_create_file("servo_log", 0444, dir, priv,
+			    &ra_ptp_servo_log_fops);
+	debugfs_create_file("servo_log.bin", 0444, dir, priv,
+			    &ra_ptp_servo_log_bin_fops);
+	debugfs_create_file("servo_stats", 0444, dir, priv,
+			    &ra_ptp_servo_stats_fops);
+	debugfs_create_file("adev", 0444, dir, priv,
+			    &ra_ptp_adev_fops);
+	debugfs_create_file("adev_tau0_ns", 0644, dir, priv,
+			    &ra_ptp_adev_tau0_fops);
+	debugfs_create_file("reset", 0200, dir, priv,
+			    &ra_ptp_monitor_reset_fops);
+}
+
+int ra_ptp_monitor_init(struct ra_ptp_priv *priv)
+{
+	struct ra_ptp_monitor *mon;
+
+	mon = devm_kzalloc(priv->dev, sizeof(*mon), GFP_KERNEL);
+	if (!mon)
+		return -ENOMEM;
+
+	spin_lock_init(&mon->lock);
+	mon->tau0_ns = NSEC_PER_SEC;
+	priv->monitor = mon;
+
+	return 0;
+}
@@ -25,6 +25,10 @@ struct ra_ptp_extts_fpga_timestamp {
 #define RA_PTP_EXTTS_CNT			1 // 1 external event as timestamp trigger
 #define RA_PTP_PEROUT_CNT			1 // 1 periodic output
 
+#define RA_PTP_PIN_EXTTS			0
+#define RA_PTP_PIN_PEROUT			1
+#define RA_PTP_PIN_CNT				2
+
 #define RA_PTP_DRIFT_CORRECTION_MAX_PPB		100000
 
 #define RA_PTP_IRQS				0x0000
@@ -65,7 +69,7 @@ struct ra_ptp_extts_fpga_timestamp {
 #define RA_PTP_READ_TIME_SECONDS		0x002c
 #define RA_PTP_READ_TIME_NANOSECONDS		0x0030
 
-#define RA_PTP_PPS_LENGTH			0x0034
+#define RA_PTP_PPS_LENGTH			0x0034	// event output pulse length, in ns
 
 #define RA_PTP_EVENT_OUT_SECONDS_H		0x0038
 #define RA_PTP_EVENT_OUT_SECONDS		0x003c
@@ -0,0 +1,194 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// #define DEBUG 1
+
+#include <linux/math64.h>
+#include <linux/timekeeping.h>
+
+#include "main.h"
+
+/* Weight of a new rate measurement, as a shift */
+#define RA_PTP_TIMEBASE_RATE_SHIFT	3
+
+static u64 ra_ptp_timebase_extrapolate(u64 phc_ns, u64 raw_ns, s64 rate_ppb,
+				       u64 now)
+{
+	s64 d = now - raw_ns;
+
+	return phc_ns + d + div_s64(d * rate_ppb, NSEC_PER_SEC);
+}
+
+/* Called with priv->lock held */
+static void ra_ptp_timebase_update(struct ra_ptp_priv *priv,
+				   u64 phc_ns, u64 raw_ns)
+{
+	struct ra_ptp_timebase *tb = &priv->tb;
+	u64 age = raw_ns - tb->raw_ns;
+	s64 rate = tb->rate_ppb;
+
+	/* Too old to compare against, start over */
+	if (raw_ns < tb->raw_ns || age > RA_PTP_TIMEBASE_MAX_AGE_NS)
+		tb->samples = 0;
+
+	if (tb->valid && tb->samples) {
+		u64 predicted = ra_ptp_timebase_extrapolate(tb->phc_ns,
+							    tb->raw_ns,
+							    tb->rate_ppb,
+							    raw_ns);
+
+		tb->last_err_ns = phc_ns - predicted;
+		tb->max_err_ns = max_t(u64, tb->max_err_ns,
+				       abs(tb->last_err_ns));
+	}
+
+	if (tb->samples && age) {
+		s64 dphc = phc_ns - tb->phc_ns;
+		s64 measured = div64_s64((dphc - (s64)age) * NSEC_PER_SEC, age);
+
+		if (tb->rate_valid)
+			rate += (measured - rate) >> RA_PTP_TIMEBASE_RATE_SHIFT;
+		else
+			rate = measured;
+
+		tb->rate_valid = true;
+	}
+
+	write_seqcount_begin(&tb->seq);
+	tb->phc_ns = phc_ns;
+	tb->raw_ns = raw_ns;
+	tb->rate_ppb = rate;
+	tb->valid = tb->rate_valid;
+	write_seqcount_end(&tb->seq);
+
+	tb->samples++;
+}
+
+long ra_ptp_timebase_work(struct ptp_clock_info *ptp)
+{
+	struct ra_ptp_priv *priv = to_ra_ptp_priv(ptp);
+	struct timespec64 ts;
+	unsigned long flags;
+	u64 raw_ns;
+
+	spin_lock_irqsave(&priv->lock, flags);
+
+	if (__ra_ptp_read_clock(priv, &ts, NULL, &raw_ns) == 0)
+		ra_ptp_timebase_update(priv, timespec64_to_ns(&ts), raw_ns);
+
+	spin_unlock_irqrestore(&priv->lock, flags);
+
+	return RA_PTP_TIMEBASE_PERIOD;
+}
+
+/*
+ * Extrapolate the hardware clock from the last sample. Lockless and safe
+ * to call from any context. Returns -EAGAIN if there is no usable sample,
+ * in which case the hardware has to be read.
+ */
+int ra_ptp_timebase_read(struct ra_ptp_priv *priv, struct timespec64 *ts)
+{
+	struct ra_ptp_timebase *tb = &priv->tb;
+	u64 phc_ns, raw_ns, now;
+	unsigned int seq;
+	s64 rate_ppb;
+	bool valid;
+
+	do {
+		seq = read_seqcount_begin(&tb->seq);
+		valid = tb->valid;
+		phc_ns = tb->phc_ns;
+		raw_ns = tb->raw_ns;
+		rate_ppb = tb->rate_ppb;
+		now = ktime_get_raw_fast_ns();
+	} while (read_seqcount_retry(&tb->seq, seq));
+
+	if (!valid || now - raw_ns > RA_PTP_TIMEBASE_MAX_AGE_NS)
+		return -EAGAIN;
+
+	*ts = ns_to_timespec64(ra_ptp_timebase_extrapolate(phc_ns, raw_ns,
+							   rate_ppb, now));
+
+	return 0;
+}
+
+/*
+ * The drift correction changed: rebase the timebase to now and apply the
+ * rate change, so readers stay valid across servo updates.
+ * Called with priv->lock held.
+ */
+void ra_ptp_timebase_set_rate(struct ra_ptp_priv *priv, s32 adj_ppb)
+{
+	struct ra_ptp_timebase *tb = &priv->tb;
+	s32 delta = adj_ppb - tb->adj_ppb;
+	u64 now = ktime_get_raw_fast_ns();
+
+	lockdep_assert_held(&priv->lock);
+
+	tb->adj_ppb = adj_ppb;
+
+	if (!delta)
+		return;
+
+	write_seqcount_begin(&tb->seq);
+
+	if (tb->valid) {
+		tb->phc_ns = ra_ptp_timebase_extrapolate(tb->phc_ns, tb->raw_ns,
+							 tb->rate_ppb, now);
+		tb->raw_ns = now;
+	}
+	tb->rate_ppb += delta;
+
+	write_seqcount_end(&tb->seq);
+
+	/*
+	 * Without a valid sample there is nothing to rebase, and the pending
+	 * rate measurement would span the change: start a fresh one.
+	 */
+	if (!tb->valid)
+		tb->samples = 0;
+}
+
+/*
+ * The hardware clock was moved by a known offset: shift the timebase along
+ * with it. The next sample must not be used for a rate measurement.
+ * Called with priv->lock held.
+ */
+void ra_ptp_timebase_step(struct ra_ptp_priv *priv, s64 delta)
+{
+	struct ra_ptp_timebase *tb = &priv->tb;
+
+	lockdep_assert_held(&priv->lock);
+
+	write_seqcount_begin(&tb->seq);
+	tb->phc_ns += delta;
+	write_seqcount_end(&tb->seq);
+
+	tb->samples = 0;
+}
+
+/*
+ * The hardware clock was set. Readers fall back to the hardware until
+ * the worker has taken a new sample, which is requested right away.
+ * Called with priv->lock held.
+ */
+void ra_ptp_timebase_invalidate(struct ra_ptp_priv *priv)
+{
+	struct ra_ptp_timebase *tb = &priv->tb;
+
+	lockdep_assert_held(&priv->lock);
+
+	write_seqcount_begin(&tb->seq);
+	tb->valid = false;
+	write_seqcount_end(&tb->seq);
+
+	/* The rate survives, only the next sample is needed */
+	tb->samples = 0;
+
+	if (priv->ptp_clock)
+		ptp_schedule_worker(priv->ptp_clock, 0);
+}
+
+void ra_ptp_timebase_init(struct ra_ptp_priv *priv)
+{
+	seqcount_spinlock_init(&priv->tb.seq, &priv->lock);
+}
@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+
+#include "main.h"
+
+static enum hrtimer_restart ra_sync_capture_timer(struct hrtimer *timer)
+{
+	struct ra_sync_priv *priv =
+		container_of(timer, struct ra_sync_priv, capture.timer);
+	struct ra_sync_capture *cap = &priv->capture;
+	struct ra_sync_servo_sample sample = {};
+	u32 ctrl = 0;
+	u64 missed;
+
+	sample.timestamp_ns = ktime_get_ns();
+
+	regmap_read(priv->regmap, RA_SYNC_SRV_DEBUG, &sample.servo_debug);
+	ra_sync_main_stat_read(priv, &sample.main_stat);
+	regmap_read(priv->regmap, RA_SYNC_MAIN_CTRL, &ctrl);
+
+	sample.source = ctrl & RA_SYNC_MAIN_SYNC_SRC_MASK;
+	if (sample.source < RA_SYNC_N_EXT_SRC)
+		regmap_read(priv->regmap, RA_SYNC_EXT_SRC_STAT(sample.source),
+			    &sample.source_stat);
+
+	if (kfifo_put(&cap->ring, sample))
+		WRITE_ONCE(cap->samples, cap->samples + 1);
+	else
+		WRITE_ONCE(cap->overruns, cap->overruns + 1);
+
+	/* Low capture rates would otherwise keep readers waiting for seconds */
+	if (kfifo_len(&cap->ring) >= RA_SYNC_CAPTURE_WAKE_BATCH ||
+	    sample.timestamp_ns - cap->last_wake_ns >= RA_SYNC_CAPTURE_WAKE_LATENCY_NS) {
+		cap->last_wake_ns = sample.timestamp_ns;
+		wake_up_interruptible(&cap->wait);
+	}
+
+	missed = hrtimer_forward_now(timer,
+			ns_to_ktime(div_u64(NSEC_PER_SEC, cap->rate_hz)));
+	if (missed > 1)
+		WRITE_ONCE(cap->missed, cap->missed + missed - 1);
+
+	return HRTIMER_RESTART;
+}
+
+/* Must be called with cap->lock held */
+static void ra_sync_capture_stop(struct ra_sync_capture *cap)
+{
+	if (!cap->enable)
+		return;
+
+	hrtimer_cancel(&cap->timer);
+	cap->enable = false;
+	wake_up_interruptible(&cap->wait);
+}
+
+/*
+ * Samples left over from an earlier capture are dropped on start. The
+ * ring can only be reset while the timer is stopped and no one reads.
+ *
+ * Must be called with cap->lock held.
+ */
+static void ra_sync_capture_start(struct ra_sync_capture *cap)
+{
+	if (cap->enable)
+		return;
+
+	mutex_lock(&cap->read_lock);
+	kfifo_reset(&cap->ring);
+	mutex_unlock(&cap->read_lock);
+
+	cap->samples = 0;
+	cap->overruns = 0;
+	cap->missed = 0;
+	cap->last_wake_ns = ktime_get_ns();
+	cap->enable = true;
+
+	hrtimer_start(&cap->timer,
+		      ns_to_ktime(div_u64(NSEC_PER_SEC, cap->rate_hz)),
+		      HRTIMER_MODE_REL);
+}
+
+static int ra_sync_capture_enable_get(void *data, u64 *val)
+{
+	struct ra_sync_priv *priv = data;
+
+	*val = READ_ONCE(priv->capture.enable);
+
+	return 0;
+}
+
+static int ra_sync_capture_enable_set(void *data, u64 val)
+{
+	struct ra_sync_priv *priv = data;
+	struct ra_sync_capture *cap = &priv->capture;
+
+	mutex_lock(&cap->lock);
+
+	if (val)
+		ra_sync_capture_start(cap);
+	else
+		ra_sync_capture_stop(cap);
+
+	mutex_unlock(&cap->lock);
+
+	return 0;
+}
+
+DEFINE_DEBUGFS_ATTRIBUTE(ra_sync_capture_enable_fops,
+			 ra_sync_capture_enable_get,
+			 ra_sync_capture_enable_set, "%llu\n");
+
+static int ra_sync_capture_rate_get(void *data, u64 *val)
+{
+	struct ra_sync_priv *priv = data;
+
+	*val = READ_ONCE(priv->capture.rate_hz);
+
+	return 0;
+}
+
+static int ra_sync_capture_rate_set(void *data, u64 val)
+{
+	struct ra_sync_priv *priv = data;
+	struct ra_sync_capture *cap = &priv->capture;
+	int ret = 0;
+
+	if (val == 0 || val > RA_SYNC_CAPTURE_MAX_RATE_HZ)
+		return -EINVAL;
+
+	mutex_lock(&cap->lock);
+
+	if (cap->enable)
+		ret = -EBUSY;
+	else
+		cap->rate_hz = val;
+
+	mutex_unlock(&cap->lock);
+
+	return ret;
+}
+
+DEFINE_DEBUGFS_ATTRIBUTE(ra_sync_capture_rate_fops,
+			 ra_sync_capture_rate_get,
+			 ra_sync_capture_rate_set, "%llu\n");
+
+static int ra_sync_capture_stats_show(struct seq_file *s, void *p)
+{
+	struct ra_sync_priv *priv = s->private;
+	struct ra_sync_capture *cap = &priv->capture;
+
+	seq_printf(s, "enabled: %d\n", READ_ONCE(cap->enable));
+	seq_printf(s, "rate: %u Hz\n", READ_ONCE(cap->rate_hz));
+	seq_printf(s, "samples: %llu\n", READ_ONCE(cap->samples));
+	seq_printf(s, "queued: %u\n", kfifo_len(&cap->ring));
+	seq_printf(s, "overruns: %llu\n", READ_ONCE(cap->overruns));
+	seq_printf(s, "missed periods: %llu\n", READ_ONCE(cap->missed));
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(ra_sync_capture_stats);
+
+/*
+ * Consume whole samples from the ring. Blocks until a batch of samples
+ * is available while the capture runs, and returns 0 once it is stopped
+ * and the ring is drained.
+ */
+static ssize_t ra_sync_capture_data_read(struct file *filp, char __user *buf,
+					 size_t count, loff_t *ppos)
+{
+	struct ra_sync_priv *priv = filp->private_data;
+	struct ra_sync_capture *cap = &priv->capture;
+	size_t size = sizeof(struct ra_sync_servo_sample);
+	unsigned int copied;
+	int ret;
+
+	count -= count % size;
+	if (count == 0)
+		return -EINVAL;
+
+	if (kfifo_is_empty(&cap->ring)) {
+		if (filp->f_flags & O_NONBLOCK)
+			return READ_ONCE(cap->enable) ? -EAGAIN : 0;
+
+		ret = wait_event_interruptible(cap->wait,
+				!kfifo_is_empty(&cap->ring) ||
+				!READ_ONCE(cap->enable));
+		if (ret < 0)
+			return ret;
+	}
+
+	ret = mutex_lock_interruptible(&cap->read_lock);
+	if (ret < 0)
+		return ret;
+
+	ret = kfifo_to_user(&cap->ring, buf, count, &copied);
+
+	mutex_unlock(&cap->read_lock);
+
+	return ret < 0 ? ret : copied;
+}
+
+static const struct file_operations ra_sync_capture_data_fops = {
+	.owner	= THIS_MODULE,
+	.open	= simple_open,
+	.read	= ra_sync_capture_data_read,
+	.llseek	= no_llseek,
+};
+
+void ra_sync_capture_debugfs_init(struct ra_sync_priv *priv,
+				  struct dentry *root)
+{
+	struct dentry *dir = debugfs_create_dir("capture", root);
+
+	debugfs_create_file("enable", 0644, dir, priv,
+			    &ra_sync_capture_enable_fops);
+	debugfs_create_file("rate_hz", 0644, dir, priv,
+			    &ra_sync_capture_rate_fops);
+	debugfs_create_file("stats", 0444, dir, priv,
+			    &ra_sync_capture_stats_fops);
+	debugfs_create_file("data", 0400, dir, priv,
+			    &ra_sync_capture_data_fops);
+}
+
+static void ra_sync_capture_free(void *data)
+{
+	struct ra_sync_capture *cap = data;
+
+	mutex_lock(&cap->lock);
+	ra_sync_capture_stop(cap);
+	mutex_unlock(&cap->lock);
+
+	kfifo_free(&cap->ring);
+}
+
+int ra_sync_capture_init(struct ra_sync_priv *priv)
+{
+	struct ra_sync_capture *cap = &priv->capture;
+	int ret;
+
+	ret = kfifo_alloc(&cap->ring, RA_SYNC_CAPTURE_RING_SIZE, GFP_KERNEL);
+	if (ret < 0)
+		return ret;
+
+	mutex_init(&cap->lock);
+	mutex_init(&cap->read_lock);
+	init_waitqueue_head(&cap->wait);
+	hrtimer_init(&cap->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	cap->timer.function = ra_sync_capture_timer;
+	cap->rate_hz = RA_SYNC_CAPTURE_DEFAULT_RATE_HZ;
+
+	return devm_add_action_or_reset(priv->dev, ra_sync_capture_free, cap);
+}
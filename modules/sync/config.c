@@ -0,0 +1,395 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <linux/clk.h>
+#include <linux/delay.h>
+
+#include "main.h"
+
+/* Sample rates, indexed by their register encoding */
+static const u32 ra_sync_rates[] = {
+	44100, 48000, 88200, 96000, 176400, 192000,
+};
+
+static int ra_sync_rate_to_reg(u32 rate)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(ra_sync_rates); i++)
+		if (ra_sync_rates[i] == rate)
+			return i;
+
+	return -EINVAL;
+}
+
+static u32 ra_sync_reg_to_rate(u32 v)
+{
+	return v < ARRAY_SIZE(ra_sync_rates) ? ra_sync_rates[v] : 0;
+}
+
+static bool ra_sync_source_valid(u32 src)
+{
+	return src < RA_SYNC_N_EXT_SRC ||
+	       src == RA_SYNC_SOURCE_PTP ||
+	       src == RA_SYNC_SOURCE_INTERNAL ||
+	       src == RA_SYNC_SOURCE_NONE;
+}
+
+static const unsigned int ra_sync_out_regs[] = {
+	RA_SYNC_OUT0_CTRL,
+	RA_SYNC_OUT1_CTRL,
+};
+
+static const unsigned int ra_sync_dars_regs[] = {
+	RA_SYNC_DARS_CS0,
+	RA_SYNC_DARS_CS1,
+	RA_SYNC_DARS_CS2,
+};
+
+/*
+ * Check a configuration and encode the register values for it. Nothing
+ * is written before the whole configuration is known to be valid.
+ */
+static int ra_sync_config_encode(const struct ra_sync_config *config,
+				 u32 *main_ctrl, u32 *out_ctrl)
+{
+	int sys, wc, i;
+
+	if (config->version != RA_SYNC_CONFIG_VERSION)
+		return -EINVAL;
+
+	if (config->reserved0 || memchr_inv(config->reserved, 0,
+					    sizeof(config->reserved)))
+		return -EINVAL;
+
+	sys = ra_sync_rate_to_reg(config->sys_rate);
+	if (sys < 0)
+		return sys;
+
+	wc = ra_sync_rate_to_reg(config->wclk_gen_rate);
+	if (wc < 0)
+		return wc;
+
+	if (!ra_sync_source_valid(config->sync_source) ||
+	    config->wclk_gen_source >= RA_SYNC_N_EXT_SRC)
+		return -EINVAL;
+
+	if (config->servo_kp > RA_SYNC_SRV_KP_CTRL_MASK ||
+	    config->servo_ki > RA_SYNC_SRV_KI_CTRL_MASK)
+		return -EINVAL;
+
+	*main_ctrl = (wc << RA_SYNC_MAIN_WC_SHIFT) |
+		     RA_SYNC_MAIN_GEN_SOURCE_EXT(config->wclk_gen_source) |
+		     (sys << RA_SYNC_MAIN_SYS_SHIFT) |
+		     RA_SYNC_MAIN_SYNC_SRC_EXT(config->sync_source);
+
+	if (config->wclk_gen_enable)
+		*main_ctrl |= RA_SYNC_MAIN_GEN_EN;
+
+	for (i = 0; i < ARRAY_SIZE(config->out); i++) {
+		const struct ra_sync_output_config *out = &config->out[i];
+
+		if (out->mode > RA_SYNC_OUT_MODE_PTP_PPS ||
+		    out->phase > RA_SYNC_OUT_PHASE_MASK)
+			return -EINVAL;
+
+		out_ctrl[i] = (out->mode << RA_SYNC_OUT_CTRL_MODE_SHIFT) |
+			      out->phase;
+
+		if (out->enable)
+			out_ctrl[i] |= RA_SYNC_OUT_ENABLE;
+	}
+
+	return 0;
+}
+
+int ra_sync_config_set(struct ra_sync_priv *priv,
+		       const struct ra_sync_config *config)
+{
+	struct ra_sync_failover *fo = &priv->failover;
+	u32 main_ctrl, out_ctrl[2];
+	int ret, i;
+
+	ret = ra_sync_config_encode(config, &main_ctrl, out_ctrl);
+	if (ret < 0)
+		return ret;
+
+	/* The failover logic owns the sync source while it is enabled */
+	mutex_lock(&fo->lock);
+	mutex_lock(&priv->mutex);
+
+	if (fo->enable && config->sync_source != fo->active) {
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+
+	if (config->mclk_rate) {
+		ret = clk_set_rate(priv->mclk, config->mclk_rate);
+		if (ret < 0)
+			goto out_unlock;
+	}
+
+	ret = regmap_write(priv->regmap, RA_SYNC_SRV_KP_CTRL, config->servo_kp);
+	if (ret < 0)
+		goto out_unlock;
+
+	ret = regmap_write(priv->regmap, RA_SYNC_SRV_KI_CTRL, config->servo_ki);
+	if (ret < 0)
+		goto out_unlock;
+
+	for (i = 0; i < ARRAY_SIZE(ra_sync_dars_regs); i++) {
+		ret = regmap_write(priv->regmap, ra_sync_dars_regs[i],
+				   config->dars_cs[i]);
+		if (ret < 0)
+			goto out_unlock;
+	}
+
+	ret = regmap_write(priv->regmap, RA_SYNC_MAIN_CTRL, main_ctrl);
+	if (ret < 0)
+		goto out_unlock;
+
+	fo->active = config->sync_source;
+
+	for (i = 0; i < ARRAY_SIZE(ra_sync_out_regs); i++) {
+		ret = regmap_write(priv->regmap, ra_sync_out_regs[i], out_ctrl[i]);
+		if (ret < 0)
+			goto out_unlock;
+	}
+
+out_unlock:
+	mutex_unlock(&priv->mutex);
+	mutex_unlock(&fo->lock);
+
+	if (ret < 0)
+		dev_err(priv->dev, "could not apply sync config: %d\n", ret);
+
+	return ret;
+}
+
+int ra_sync_config_get(struct ra_sync_priv *priv, struct ra_sync_config *config)
+{
+	u32 v;
+	int ret, i;
+
+	memset(config, 0, sizeof(*config));
+	config->version = RA_SYNC_CONFIG_VERSION;
+
+	mutex_lock(&priv->mutex);
+
+	ret = regmap_read(priv->regmap, RA_SYNC_MAIN_CTRL, &v);
+	if (ret < 0)
+		goto out_unlock;
+
+	config->sys_rate = ra_sync_reg_to_rate((v & RA_SYNC_MAIN_SYS_MASK) >>
+					       RA_SYNC_MAIN_SYS_SHIFT);
+	config->sync_source = v & RA_SYNC_MAIN_SYNC_SRC_MASK;
+	config->wclk_gen_enable = !!(v & RA_SYNC_MAIN_GEN_EN);
+	config->wclk_gen_rate = ra_sync_reg_to_rate((v & RA_SYNC_MAIN_WC_MASK) >>
+						    RA_SYNC_MAIN_WC_SHIFT);
+	config->wclk_gen_source = (v & RA_SYNC_MAIN_GEN_SOURCE_MASK) >>
+				  RA_SYNC_MAIN_GEN_SOURCE_SHIFT;
+
+	for (i = 0; i < ARRAY_SIZE(ra_sync_out_regs); i++) {
+		ret = regmap_read(priv->regmap, ra_sync_out_regs[i], &v);
+		if (ret < 0)
+			goto out_unlock;
+
+		config->out[i].enable = !!(v & RA_SYNC_OUT_ENABLE);
+		config->out[i].mode = (v & RA_SYNC_OUT_CTRL_MODE_MASK) >>
+				      RA_SYNC_OUT_CTRL_MODE_SHIFT;
+		config->out[i].phase = v & RA_SYNC_OUT_PHASE_MASK;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(ra_sync_dars_regs); i++) {
+		ret = regmap_read(priv->regmap, ra_sync_dars_regs[i],
+				  &config->dars_cs[i]);
+		if (ret < 0)
+			goto out_unlock;
+	}
+
+	ret = regmap_read(priv->regmap, RA_SYNC_SRV_KP_CTRL, &v);
+	if (ret < 0)
+		goto out_unlock;
+
+	config->servo_kp = v & RA_SYNC_SRV_KP_CTRL_MASK;
+
+	ret = regmap_read(priv->regmap, RA_SYNC_SRV_KI_CTRL, &v);
+	if (ret < 0)
+		goto out_unlock;
+
+	config->servo_ki = v & RA_SYNC_SRV_KI_CTRL_MASK;
+	config->mclk_rate = clk_get_rate(priv->mclk);
+
+out_unlock:
+	mutex_unlock(&priv->mutex);
+
+	return ret;
+}
+
+/*
+ * Reading RA_SYNC_MAIN_STAT clears its sticky bits. Reads done by the
+ * driver itself keep them in main_stat_sticky, so that they are still
+ * reported by the next RA_SYNC_GET_STATUS.
+ */
+int ra_sync_main_stat_read(struct ra_sync_priv *priv, u32 *stat)
+{
+	int ret;
+
+	ret = regmap_read(priv->regmap, RA_SYNC_MAIN_STAT, stat);
+	if (ret < 0)
+		return ret;
+
+	atomic_or(*stat & RA_SYNC_MAIN_STAT_STICKY, &priv->main_stat_sticky);
+
+	return 0;
+}
+
+int ra_sync_status_get(struct ra_sync_priv *priv, struct ra_sync_status *status)
+{
+	int ret, i;
+
+	memset(status, 0, sizeof(*status));
+	status->version = RA_SYNC_CONFIG_VERSION;
+
+	mutex_lock(&priv->mutex);
+
+	ret = regmap_read(priv->regmap, RA_SYNC_MAIN_STAT, &status->main_stat);
+	if (ret < 0)
+		goto out_unlock;
+
+	status->main_stat |= atomic_xchg(&priv->main_stat_sticky, 0);
+
+	ret = regmap_read(priv->regmap, RA_SYNC_MAIN_CTRL, &status->main_ctrl);
+	if (ret < 0)
+		goto out_unlock;
+
+	ret = regmap_read(priv->regmap, RA_SYNC_SRV_DEBUG, &status->servo_debug);
+	if (ret < 0)
+		goto out_unlock;
+
+	for (i = 0; i < RA_SYNC_N_EXT_SRC; i++) {
+		ret = regmap_read(priv->regmap, RA_SYNC_EXT_SRC_STAT(i),
+				  &status->ext_src_stat[i]);
+		if (ret < 0)
+			goto out_unlock;
+	}
+
+	status->pll_locked = !!(status->main_stat & RA_SYNC_MAIN_STAT_PLL1_LOCKED);
+	status->active_source = status->main_ctrl & RA_SYNC_MAIN_SYNC_SRC_MASK;
+	status->mclk_rate = clk_get_rate(priv->mclk);
+	status->source_switches = READ_ONCE(priv->failover.switches);
+
+out_unlock:
+	mutex_unlock(&priv->mutex);
+
+	return ret;
+}
+
+/*
+ * Switch the media clock in one go: MCLK first, so the PLL has its new
+ * reference by the time the sample rate changes, then the system rate.
+ * The sync source, word clock generator and outputs are left as they
+ * are. Waiting for the lock is bounded by the timeout, so callers that
+ * paused their streams know when they can resume them.
+ */
+int ra_sync_media_clock_set(struct ra_sync_priv *priv,
+			    struct ra_sync_media_clock *mc)
+{
+	unsigned int timeout_ms = mc->timeout_ms ?:
+				  RA_SYNC_MEDIA_CLOCK_DEFAULT_TIMEOUT_MS;
+	u64 mclk_rate = mc->mclk_rate ?: (u64)mc->rate * 512;
+	unsigned int locked_polls = 0;
+	bool unlock_seen = false;
+	ktime_t start, deadline;
+	u32 stat, sticky = 0;
+	int ret, sys;
+
+	sys = ra_sync_rate_to_reg(mc->rate);
+	if (sys < 0)
+		return sys;
+
+	if (timeout_ms > RA_SYNC_MEDIA_CLOCK_MAX_TIMEOUT_MS)
+		return -EINVAL;
+
+	mutex_lock(&priv->mutex);
+
+	/*
+	 * Clear the sticky unlock bit, in the hardware and in the driver's
+	 * copy, so only an unlock caused by the switch is seen. The capture
+	 * timer and the IRQ thread read the status as well and may consume
+	 * the hardware bit first, so the driver's copy is checked on every
+	 * poll. Whatever is taken from it is given back for status readers.
+	 */
+	ret = ra_sync_main_stat_read(priv, &stat);
+	if (ret < 0)
+		goto out_unlock;
+
+	sticky = atomic_xchg(&priv->main_stat_sticky, 0);
+
+	ret = clk_set_rate(priv->mclk, mclk_rate);
+	if (ret < 0)
+		goto out_unlock;
+
+	ret = regmap_update_bits(priv->regmap, RA_SYNC_MAIN_CTRL,
+				 RA_SYNC_MAIN_SYS_MASK,
+				 sys << RA_SYNC_MAIN_SYS_SHIFT);
+	if (ret < 0)
+		goto out_unlock;
+
+	start = ktime_get();
+	deadline = ktime_add_ms(start, timeout_ms);
+
+	/*
+	 * The PLL may still report the lock at the old rate for a while, so
+	 * accept a lock only after an unlock was observed, or once it was
+	 * stable for RA_SYNC_MEDIA_CLOCK_STABLE_POLLS polls in case the PLL
+	 * held lock across the switch.
+	 */
+	for (;;) {
+		ret = ra_sync_main_stat_read(priv, &stat);
+		if (ret < 0)
+			goto out_unlock;
+
+		stat |= atomic_xchg(&priv->main_stat_sticky, 0);
+		sticky |= stat & RA_SYNC_MAIN_STAT_STICKY;
+
+		if (stat & RA_SYNC_MAIN_STAT_PLL1_UNLOCK_S)
+			unlock_seen = true;
+
+		if (stat & RA_SYNC_MAIN_STAT_PLL1_LOCKED) {
+			locked_polls++;
+			if (unlock_seen ||
+			    locked_polls >= RA_SYNC_MEDIA_CLOCK_STABLE_POLLS)
+				break;
+		} else {
+			unlock_seen = true;
+			locked_polls = 0;
+		}
+
+		if (ktime_after(ktime_get(), deadline)) {
+			ret = -ETIMEDOUT;
+			goto out_unlock;
+		}
+
+		usleep_range(500, 1000);
+	}
+
+	mc->lock_time_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	dev_dbg(priv->dev, "media clock %u Hz, PLL locked after %llu ns\n",
+		mc->rate, mc->lock_time_ns);
+
+out_unlock:
+	atomic_or(sticky, &priv->main_stat_sticky);
+
+	mutex_unlock(&priv->mutex);
+
+	if (ret == -ETIMEDOUT)
+		dev_err(priv->dev, "PLL did not lock within %u ms at %u Hz\n",
+			timeout_ms, mc->rate);
+
+	if (ret == 0)
+		ra_sync_events_queue(priv, ktime_get_ns(),
+				     RA_SYNC_EVENT_MEDIA_CLOCK, -1, mc->rate);
+
+	return ret;
+}
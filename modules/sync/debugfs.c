@@ -12,6 +12,8 @@
 static int ra_sync_summary_show(struct seq_file *s, void *p)
 {
 	struct ra_sync_priv *priv = s->private;
+	struct ra_sync_failover *fo = &priv->failover;
+	unsigned int i;
 
 	mutex_lock(&priv->mutex);
 
@@ -19,9 +21,24 @@ static int ra_sync_summary_show(struct seq_file *s, void *p)
 	seq_printf(s, "  Driver version: %s\n", ra_driver_version());
 	seq_printf(s, "  Device name: %s\n", priv->misc.name);
 	seq_printf(s, "  MCLK frequency: %lu\n", clk_get_rate(priv->mclk));
+	seq_printf(s, "  Event IRQ overflows: %llu\n",
+		   READ_ONCE(priv->events.irq_overflows));
 
 	mutex_unlock(&priv->mutex);
 
+	mutex_lock(&fo->lock);
+
+	seq_printf(s, "  Failover: %s\n", fo->enable ? "enabled" : "disabled");
+	seq_printf(s, "  Failover hold-off: %u ms\n", fo->hold_off_ms);
+	seq_puts(s, "  Failover sources:");
+	for (i = 0; i < fo->n_sources; i++)
+		seq_printf(s, " 0x%x", fo->sources[i]);
+	seq_puts(s, "\n");
+	seq_printf(s, "  Active source: 0x%x\n", fo->active);
+	seq_printf(s, "  Source switches: %llu\n", fo->switches);
+
+	mutex_unlock(&fo->lock);
+
 	return 0;
 }
 
@@ -48,5 +65,7 @@ int ra_sync_debugfs_init(struct ra_sync_priv *priv)
 	debugfs_create_file("summary", 0444, priv->debugfs,
 			    priv, &ra_sync_summary_fops);
 
+	ra_sync_capture_debugfs_init(priv, priv->debugfs);
+
 	return 0;
 }
@@ -0,0 +1,271 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <linux/fs.h>
+#include <linux/kfifo.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+
+#include "main.h"
+
+#define RA_SYNC_EVENTS_READER_FIFO_SIZE	64
+#define RA_SYNC_EVENTS_READ_BATCH	16
+
+struct ra_sync_reader {
+	struct ra_sync_priv	*priv;
+	struct list_head	node;
+	DECLARE_KFIFO(fifo, struct ra_sync_event,
+		      RA_SYNC_EVENTS_READER_FIFO_SIZE);
+};
+
+/*
+ * Hard IRQ half: latch and clear the interrupt status, and take the
+ * timestamp as close to the event as possible.
+ */
+irqreturn_t ra_sync_irq_handler(int irq, void *devid)
+{
+	struct ra_sync_priv *priv = devid;
+	struct ra_sync_events *events = &priv->events;
+	struct ra_sync_irq e;
+	int ret;
+
+	e.timestamp_ns = ktime_get_ns();
+
+	ret = regmap_read(priv->regmap, RA_SYNC_IRQ_STAT0, &e.stat);
+	if (ret < 0)
+		return IRQ_NONE;
+
+	e.stat &= RA_SYNC_IRQ_STAT0_EVENTS;
+	if (!e.stat)
+		return IRQ_NONE;
+
+	if (!kfifo_put(&events->irqs, e))
+		WRITE_ONCE(events->irq_overflows, events->irq_overflows + 1);
+
+	return IRQ_WAKE_THREAD;
+}
+
+/*
+ * Hand an event to all readers. When a reader's queue is full, its
+ * oldest event is dropped, as the recent state is the more useful one.
+ */
+void ra_sync_events_queue(struct ra_sync_priv *priv, u64 timestamp_ns,
+			  u32 type, int source, u32 status)
+{
+	struct ra_sync_events *events = &priv->events;
+	struct ra_sync_reader *reader;
+	struct ra_sync_event ev;
+	unsigned long flags;
+
+	spin_lock_irqsave(&events->lock, flags);
+
+	ev.timestamp_ns = timestamp_ns;
+	ev.type = type;
+	ev.source = source;
+	ev.status = status;
+	ev.seq = events->seq++;
+
+	list_for_each_entry(reader, &events->readers, node) {
+		if (kfifo_is_full(&reader->fifo))
+			kfifo_skip(&reader->fifo);
+
+		kfifo_put(&reader->fifo, ev);
+	}
+
+	spin_unlock_irqrestore(&events->lock, flags);
+
+	wake_up_interruptible(&events->wait);
+}
+
+/*
+ * IRQ thread half: decode the latched status bits into events. Status
+ * registers are sampled here rather than in the hard IRQ, so they may
+ * already reflect a later state than the one that raised the interrupt.
+ */
+irqreturn_t ra_sync_irq_thread(int irq, void *devid)
+{
+	struct ra_sync_priv *priv = devid;
+	struct ra_sync_events *events = &priv->events;
+	struct ra_sync_irq e;
+	bool ext = false;
+	u32 status;
+	int n;
+
+	while (kfifo_get(&events->irqs, &e)) {
+		dev_dbg(priv->dev, "%s(): IRQ_STAT0 0x%08x\n", __func__, e.stat);
+
+		if (e.stat & (RA_SYNC_IRQ_STAT0_PLL_UNLOCK |
+			      RA_SYNC_IRQ_STAT0_PHASE_ADJUST)) {
+			status = 0;
+			ra_sync_main_stat_read(priv, &status);
+
+			if (e.stat & RA_SYNC_IRQ_STAT0_PLL_UNLOCK)
+				ra_sync_events_queue(priv, e.timestamp_ns,
+						     RA_SYNC_EVENT_PLL_UNLOCK,
+						     -1, status);
+
+			if (e.stat & RA_SYNC_IRQ_STAT0_PHASE_ADJUST)
+				ra_sync_events_queue(priv, e.timestamp_ns,
+						     RA_SYNC_EVENT_PHASE_ADJUST,
+						     -1, status);
+		}
+
+		for (n = 0; n < RA_SYNC_N_EXT_SRC; n++) {
+			u32 mask = RA_SYNC_IRQ_STAT0_SD_EXT(n) |
+				   RA_SYNC_IRQ_STAT0_SR_EXT(n) |
+				   RA_SYNC_IRQ_STAT0_TYP_EXT(n);
+
+			if (!(e.stat & mask))
+				continue;
+
+			ext = true;
+
+			status = 0;
+			regmap_read(priv->regmap, RA_SYNC_EXT_SRC_STAT(n), &status);
+
+			if (e.stat & RA_SYNC_IRQ_STAT0_SD_EXT(n))
+				ra_sync_events_queue(priv, e.timestamp_ns,
+						     RA_SYNC_EVENT_SIGNAL_DETECT,
+						     n, status);
+
+			if (e.stat & RA_SYNC_IRQ_STAT0_SR_EXT(n))
+				ra_sync_events_queue(priv, e.timestamp_ns,
+						     RA_SYNC_EVENT_SAMPLE_RATE,
+						     n, status);
+
+			if (e.stat & RA_SYNC_IRQ_STAT0_TYP_EXT(n))
+				ra_sync_events_queue(priv, e.timestamp_ns,
+						     RA_SYNC_EVENT_TYPE,
+						     n, status);
+		}
+	}
+
+	if (ext)
+		ra_sync_failover_update(priv);
+
+	return IRQ_HANDLED;
+}
+
+static bool ra_sync_reader_empty(struct ra_sync_reader *reader)
+{
+	struct ra_sync_events *events = &reader->priv->events;
+	unsigned long flags;
+	bool empty;
+
+	spin_lock_irqsave(&events->lock, flags);
+	empty = kfifo_is_empty(&reader->fifo);
+	spin_unlock_irqrestore(&events->lock, flags);
+
+	return empty;
+}
+
+struct ra_sync_priv *ra_sync_file_priv(struct file *filp)
+{
+	struct ra_sync_reader *reader = filp->private_data;
+
+	return reader->priv;
+}
+
+int ra_sync_events_open(struct inode *inode, struct file *filp)
+{
+	struct ra_sync_priv *priv = to_ra_sync_priv(filp->private_data);
+	struct ra_sync_reader *reader;
+	unsigned long flags;
+
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
+	reader->priv = priv;
+	INIT_KFIFO(reader->fifo);
+
+	spin_lock_irqsave(&priv->events.lock, flags);
+	list_add_tail(&reader->node, &priv->events.readers);
+	spin_unlock_irqrestore(&priv->events.lock, flags);
+
+	filp->private_data = reader;
+
+	return stream_open(inode, filp);
+}
+
+int ra_sync_events_release(struct inode *inode, struct file *filp)
+{
+	struct ra_sync_reader *reader = filp->private_data;
+	struct ra_sync_events *events = &reader->priv->events;
+	unsigned long flags;
+
+	spin_lock_irqsave(&events->lock, flags);
+	list_del(&reader->node);
+	spin_unlock_irqrestore(&events->lock, flags);
+
+	kfree(reader);
+
+	return 0;
+}
+
+ssize_t ra_sync_events_read(struct file *filp, char __user *buf,
+			    size_t count, loff_t *ppos)
+{
+	struct ra_sync_reader *reader = filp->private_data;
+	struct ra_sync_events *events = &reader->priv->events;
+	struct ra_sync_event ev[RA_SYNC_EVENTS_READ_BATCH];
+	size_t n = count / sizeof(ev[0]);
+	unsigned long flags;
+	ssize_t done = 0;
+	int ret;
+
+	if (n == 0)
+		return -EINVAL;
+
+	if (filp->f_flags & O_NONBLOCK) {
+		if (ra_sync_reader_empty(reader))
+			return -EAGAIN;
+	} else {
+		ret = wait_event_interruptible(events->wait,
+				!ra_sync_reader_empty(reader));
+		if (ret < 0)
+			return ret;
+	}
+
+	while (n) {
+		unsigned int got;
+
+		spin_lock_irqsave(&events->lock, flags);
+		got = kfifo_out(&reader->fifo, ev,
+				min_t(size_t, n, ARRAY_SIZE(ev)));
+		spin_unlock_irqrestore(&events->lock, flags);
+
+		if (!got)
+			break;
+
+		if (copy_to_user(buf + done, ev, got * sizeof(ev[0])))
+			return done ? done : -EFAULT;
+
+		done += got * sizeof(ev[0]);
+		n -= got;
+	}
+
+	return done;
+}
+
+__poll_t ra_sync_events_poll(struct file *filp, poll_table *wait)
+{
+	struct ra_sync_reader *reader = filp->private_data;
+
+	poll_wait(filp, &reader->priv->events.wait, wait);
+
+	if (!ra_sync_reader_empty(reader))
+		return EPOLLIN | EPOLLRDNORM;
+
+	return 0;
+}
+
+void ra_sync_events_init(struct ra_sync_priv *priv)
+{
+	struct ra_sync_events *events = &priv->events;
+
+	INIT_KFIFO(events->irqs);
+	spin_lock_init(&events->lock);
+	INIT_LIST_HEAD(&events->readers);
+	init_waitqueue_head(&events->wait);
+}
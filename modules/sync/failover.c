@@ -0,0 +1,257 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <linux/jiffies.h>
+#include <linux/of.h>
+
+#include "main.h"
+
+static bool ra_sync_failover_source_valid(u8 src)
+{
+	return src < RA_SYNC_N_EXT_SRC ||
+	       src == RA_SYNC_SOURCE_PTP ||
+	       src == RA_SYNC_SOURCE_INTERNAL;
+}
+
+static bool ra_sync_ext_src_usable(struct ra_sync_priv *priv, unsigned int n)
+{
+	u32 stat;
+
+	if (regmap_read(priv->regmap, RA_SYNC_EXT_SRC_STAT(n), &stat) < 0)
+		return false;
+
+	return (stat & (RA_SYNC_EXT_SRC_STAT_SD_VID |
+			RA_SYNC_EXT_SRC_STAT_SD_AES3 |
+			RA_SYNC_EXT_SRC_STAT_SD_WCLK)) &&
+	       (stat & RA_SYNC_EXT_SRC_STAT_FS_LOCK);
+}
+
+static int ra_sync_failover_switch(struct ra_sync_priv *priv, u8 src)
+{
+	struct ra_sync_failover *fo = &priv->failover;
+	u8 prev = fo->active;
+	int ret;
+
+	ret = regmap_update_bits(priv->regmap, RA_SYNC_MAIN_CTRL,
+				 RA_SYNC_MAIN_SYNC_SRC_MASK,
+				 RA_SYNC_MAIN_SYNC_SRC_EXT(src));
+	if (ret < 0)
+		return ret;
+
+	fo->active = src;
+	fo->switches++;
+
+	dev_info(priv->dev, "sync source switched from 0x%x to 0x%x\n",
+		 prev, src);
+
+	ra_sync_events_queue(priv, ktime_get_ns(),
+			     RA_SYNC_EVENT_SOURCE_SWITCH, src, prev);
+
+	return 0;
+}
+
+/*
+ * Pick the first usable source in the list. The active source is kept
+ * as long as it is usable, and an external source that recently became
+ * usable is only taken once it has been so for the hold-off time. A
+ * loss of the active source therefore switches right away, while
+ * switching back waits for the new source to settle.
+ *
+ * Must be called with fo->lock held.
+ */
+static void ra_sync_failover_evaluate(struct ra_sync_priv *priv)
+{
+	struct ra_sync_failover *fo = &priv->failover;
+	unsigned long hold = msecs_to_jiffies(fo->hold_off_ms);
+	unsigned long delay = msecs_to_jiffies(RA_SYNC_FAILOVER_POLL_MS);
+	unsigned long now = jiffies;
+	unsigned int i;
+
+	if (!fo->enable)
+		return;
+
+	for (i = 0; i < RA_SYNC_N_EXT_SRC; i++) {
+		if (!ra_sync_ext_src_usable(priv, i))
+			fo->good_since[i] = 0;
+		else if (!fo->good_since[i])
+			fo->good_since[i] = now ?: 1;
+	}
+
+	for (i = 0; i < fo->n_sources; i++) {
+		u8 src = fo->sources[i];
+
+		if (src < RA_SYNC_N_EXT_SRC) {
+			unsigned long since = fo->good_since[src];
+
+			if (!since)
+				continue;
+
+			if (src != fo->active && time_before(now, since + hold)) {
+				delay = min(delay, since + hold - now);
+				continue;
+			}
+		}
+
+		if (src != fo->active)
+			ra_sync_failover_switch(priv, src);
+
+		break;
+	}
+
+	mod_delayed_work(system_wq, &fo->work, delay);
+}
+
+static void ra_sync_failover_work(struct work_struct *work)
+{
+	struct ra_sync_priv *priv =
+		container_of(work, struct ra_sync_priv, failover.work.work);
+
+	ra_sync_failover_update(priv);
+}
+
+void ra_sync_failover_update(struct ra_sync_priv *priv)
+{
+	struct ra_sync_failover *fo = &priv->failover;
+
+	mutex_lock(&fo->lock);
+	ra_sync_failover_evaluate(priv);
+	mutex_unlock(&fo->lock);
+}
+
+static u8 ra_sync_failover_read_active(struct ra_sync_priv *priv)
+{
+	u32 ctrl = 0;
+
+	regmap_read(priv->regmap, RA_SYNC_MAIN_CTRL, &ctrl);
+
+	return ctrl & RA_SYNC_MAIN_SYNC_SRC_MASK;
+}
+
+/*
+ * Sources that are usable when failover is enabled count as settled,
+ * so that the first evaluation does not wait for the hold-off time.
+ *
+ * Must be called with fo->lock held.
+ */
+static void __ra_sync_failover_enable(struct ra_sync_priv *priv)
+{
+	struct ra_sync_failover *fo = &priv->failover;
+	unsigned long settled = jiffies - msecs_to_jiffies(fo->hold_off_ms);
+	unsigned int i;
+
+	fo->active = ra_sync_failover_read_active(priv);
+
+	for (i = 0; i < RA_SYNC_N_EXT_SRC; i++)
+		fo->good_since[i] = ra_sync_ext_src_usable(priv, i) ?
+				    (settled ?: 1) : 0;
+
+	fo->enable = true;
+	ra_sync_failover_evaluate(priv);
+}
+
+int ra_sync_failover_set(struct ra_sync_priv *priv,
+			 const struct ra_sync_failover_config *config)
+{
+	struct ra_sync_failover *fo = &priv->failover;
+	unsigned int i;
+
+	if (config->n_sources > RA_SYNC_FAILOVER_MAX_SOURCES)
+		return -EINVAL;
+
+	if (config->enable && !config->n_sources)
+		return -EINVAL;
+
+	for (i = 0; i < config->n_sources; i++)
+		if (!ra_sync_failover_source_valid(config->sources[i]))
+			return -EINVAL;
+
+	mutex_lock(&fo->lock);
+
+	fo->enable = false;
+	fo->hold_off_ms = config->hold_off_ms;
+	fo->n_sources = config->n_sources;
+	memcpy(fo->sources, config->sources, config->n_sources);
+
+	if (config->enable)
+		__ra_sync_failover_enable(priv);
+
+	mutex_unlock(&fo->lock);
+
+	if (!config->enable)
+		cancel_delayed_work_sync(&fo->work);
+
+	return 0;
+}
+
+void ra_sync_failover_get(struct ra_sync_priv *priv,
+			  struct ra_sync_failover_config *config)
+{
+	struct ra_sync_failover *fo = &priv->failover;
+
+	memset(config, 0, sizeof(*config));
+
+	mutex_lock(&fo->lock);
+	config->enable = fo->enable;
+	config->hold_off_ms = fo->hold_off_ms;
+	config->n_sources = fo->n_sources;
+	memcpy(config->sources, fo->sources, fo->n_sources);
+	mutex_unlock(&fo->lock);
+}
+
+static void ra_sync_failover_cancel(void *data)
+{
+	struct ra_sync_failover *fo = data;
+
+	mutex_lock(&fo->lock);
+	fo->enable = false;
+	mutex_unlock(&fo->lock);
+
+	cancel_delayed_work_sync(&fo->work);
+}
+
+/*
+ * Failover is enabled at probe time if the device tree lists the
+ * sources in 'lawo,sync-source-priority'.
+ */
+int ra_sync_failover_init(struct ra_sync_priv *priv)
+{
+	struct ra_sync_failover *fo = &priv->failover;
+	struct ra_sync_failover_config config = {
+		.hold_off_ms = RA_SYNC_FAILOVER_DEFAULT_HOLD_OFF_MS,
+	};
+	struct device_node *node = priv->dev->of_node;
+	int ret, n;
+
+	mutex_init(&fo->lock);
+	INIT_DELAYED_WORK(&fo->work, ra_sync_failover_work);
+	fo->hold_off_ms = RA_SYNC_FAILOVER_DEFAULT_HOLD_OFF_MS;
+
+	ret = devm_add_action_or_reset(priv->dev, ra_sync_failover_cancel, fo);
+	if (ret < 0)
+		return ret;
+
+	of_property_read_u32(node, "lawo,sync-source-hold-off-ms",
+			     &config.hold_off_ms);
+
+	n = of_property_count_u8_elems(node, "lawo,sync-source-priority");
+	if (n <= 0)
+		return 0;
+
+	if (n > RA_SYNC_FAILOVER_MAX_SOURCES) {
+		dev_err(priv->dev, "too many sync sources in priority list\n");
+		return -EINVAL;
+	}
+
+	ret = of_property_read_u8_array(node, "lawo,sync-source-priority",
+					config.sources, n);
+	if (ret < 0)
+		return ret;
+
+	config.n_sources = n;
+	config.enable = true;
+
+	ret = ra_sync_failover_set(priv, &config);
+	if (ret < 0)
+		dev_err(priv->dev, "invalid sync source priority list\n");
+
+	return ret;
+}
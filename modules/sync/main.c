@@ -16,13 +16,6 @@
 
 #include "main.h"
 
-static irqreturn_t ra_sync_irqhandler(int irq, void *devid)
-{
-	struct ra_sync_priv *priv = devid;
-
-	return IRQ_HANDLED;
-}
-
 static int ra_sync_set_frequency_ioctl(struct ra_sync_priv *priv,
 				       unsigned int size, void __user *buf)
 {
@@ -37,17 +30,115 @@ static int ra_sync_set_frequency_ioctl(struct ra_sync_priv *priv,
 	return clk_set_rate(priv->mclk, freq);
 }
 
+static int ra_sync_set_failover_ioctl(struct ra_sync_priv *priv,
+				      void __user *buf)
+{
+	struct ra_sync_failover_config config;
+
+	if (copy_from_user(&config, buf, sizeof(config)))
+		return -EFAULT;
+
+	return ra_sync_failover_set(priv, &config);
+}
+
+static int ra_sync_get_failover_ioctl(struct ra_sync_priv *priv,
+				      void __user *buf)
+{
+	struct ra_sync_failover_config config;
+
+	ra_sync_failover_get(priv, &config);
+
+	if (copy_to_user(buf, &config, sizeof(config)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int ra_sync_get_config_ioctl(struct ra_sync_priv *priv,
+				    void __user *buf)
+{
+	struct ra_sync_config config;
+	int ret;
+
+	ret = ra_sync_config_get(priv, &config);
+	if (ret < 0)
+		return ret;
+
+	if (copy_to_user(buf, &config, sizeof(config)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int ra_sync_set_config_ioctl(struct ra_sync_priv *priv,
+				    void __user *buf)
+{
+	struct ra_sync_config config;
+
+	if (copy_from_user(&config, buf, sizeof(config)))
+		return -EFAULT;
+
+	return ra_sync_config_set(priv, &config);
+}
+
+static int ra_sync_get_status_ioctl(struct ra_sync_priv *priv,
+				    void __user *buf)
+{
+	struct ra_sync_status status;
+	int ret;
+
+	ret = ra_sync_status_get(priv, &status);
+	if (ret < 0)
+		return ret;
+
+	if (copy_to_user(buf, &status, sizeof(status)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int ra_sync_set_media_clock_ioctl(struct ra_sync_priv *priv,
+					 void __user *buf)
+{
+	struct ra_sync_media_clock mc;
+	int ret;
+
+	if (copy_from_user(&mc, buf, sizeof(mc)))
+		return -EFAULT;
+
+	ret = ra_sync_media_clock_set(priv, &mc);
+	if (ret < 0)
+		return ret;
+
+	if (copy_to_user(buf, &mc, sizeof(mc)))
+		return -EFAULT;
+
+	return 0;
+}
+
 static long ra_sync_ioctl(struct file *filp,
 			  unsigned int cmd,
 			  unsigned long arg)
 {
-	struct ra_sync_priv *priv = to_ra_sync_priv(filp->private_data);
+	struct ra_sync_priv *priv = ra_sync_file_priv(filp);
 	void __user *buf = (void __user *)arg;
 	unsigned int size = _IOC_SIZE(cmd);
 
 	switch (cmd) {
 	case RA_SYNC_SET_MCLK_FREQUENCY:
 		return ra_sync_set_frequency_ioctl(priv, size, buf);
+	case RA_SYNC_SET_FAILOVER:
+		return ra_sync_set_failover_ioctl(priv, buf);
+	case RA_SYNC_GET_FAILOVER:
+		return ra_sync_get_failover_ioctl(priv, buf);
+	case RA_SYNC_GET_CONFIG:
+		return ra_sync_get_config_ioctl(priv, buf);
+	case RA_SYNC_SET_CONFIG:
+		return ra_sync_set_config_ioctl(priv, buf);
+	case RA_SYNC_GET_STATUS:
+		return ra_sync_get_status_ioctl(priv, buf);
+	case RA_SYNC_SET_MEDIA_CLOCK:
+		return ra_sync_set_media_clock_ioctl(priv, buf);
 	}
 
 	return -ENOTTY;
@@ -55,9 +146,22 @@ static long ra_sync_ioctl(struct file *filp,
 
 static const struct file_operations ra_sync_fops =
 {
+	.owner		= THIS_MODULE,
+	.open		= ra_sync_events_open,
+	.release	= ra_sync_events_release,
+	.read		= ra_sync_events_read,
+	.poll		= ra_sync_events_poll,
 	.unlocked_ioctl	= &ra_sync_ioctl,
+	.llseek		= no_llseek,
 };
 
+static void ra_sync_irq_disable(void *data)
+{
+	struct ra_sync_priv *priv = data;
+
+	regmap_write(priv->regmap, RA_SYNC_IRQ_CTRL, 0);
+}
+
 static void ra_sync_mclk_disable_unpreprare(void *c)
 {
 	clk_disable_unprepare(c);
@@ -114,14 +218,29 @@ static int ra_sync_probe(struct platform_device *pdev)
 	if (IS_ERR(priv->regmap))
 		return PTR_ERR(priv->regmap);
 
+	ra_sync_events_init(priv);
+
+	ret = ra_sync_failover_init(priv);
+	if (ret < 0)
+		return ret;
+
 	irq = of_irq_get(dev->of_node, 0);
-	ret = devm_request_irq(dev, irq, ra_sync_irqhandler, IRQF_SHARED,
-			       dev_name(dev), priv);
+	ret = devm_request_threaded_irq(dev, irq, ra_sync_irq_handler,
+					ra_sync_irq_thread, IRQF_SHARED,
+					dev_name(dev), priv);
 	if (ret < 0) {
 		dev_err(dev, "could not request irq: %d\n", ret);
 		return ret;
 	}
 
+	ret = regmap_write(priv->regmap, RA_SYNC_IRQ_CTRL, RA_SYNC_IRQ_STAT0_EVENTS);
+	if (ret < 0)
+		return ret;
+
+	ret = devm_add_action_or_reset(dev, ra_sync_irq_disable, priv);
+	if (ret < 0)
+		return ret;
+
 	ret = of_property_read_string(dev->of_node, "lawo,device-name", &name);
 	if (ret < 0) {
 		dev_err(dev, "No lawo,device-name property: %d\n", ret);
@@ -159,6 +278,10 @@ static int ra_sync_probe(struct platform_device *pdev)
 	if (ret < 0)
 		return ret;
 
+	ret = ra_sync_capture_init(priv);
+	if (ret < 0)
+		return ret;
+
 	ret = ra_sync_debugfs_init(priv);
 	if (ret < 0)
 		return ret;
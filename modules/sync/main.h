@@ -3,10 +3,17 @@
 #ifndef RA_SYNC_MAIN_H
 #define RA_SYNC_MAIN_H
 
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
 #include <linux/io.h>
+#include <linux/kfifo.h>
 #include <linux/miscdevice.h>
 #include <linux/module.h>
+#include <linux/poll.h>
 #include <linux/regmap.h>
+#include <linux/workqueue.h>
+
+#include <uapi/ravenna/sync.h>
 
 #define RA_SYNC_N_EXT_SRC			10
 
@@ -17,6 +24,10 @@
 #define RA_SYNC_IRQ_STAT0_PLL_UNLOCK		BIT(30)
 #define RA_SYNC_IRQ_STAT0_PHASE_ADJUST		BIT(31)
 
+#define RA_SYNC_IRQ_STAT0_EVENTS		(GENMASK(29, 0) | \
+						 RA_SYNC_IRQ_STAT0_PLL_UNLOCK | \
+						 RA_SYNC_IRQ_STAT0_PHASE_ADJUST)
+
 #define RA_SYNC_IRQ_STAT1			0x04 /* R Interrupt Request 1 */
 #define RA_SYNC_IRQ_CTRL			0x08 /* R/W Interrupt Request Control */
 
@@ -33,6 +44,8 @@
 #define RA_SYNC_OUT_CTRL_WCLK			(0 << 9)
 #define RA_SYNC_OUT_CTRL_DARS			(1 << 9)
 #define RA_SYNC_OUT_CTRL_PTP_PPS		(2 << 9)
+#define RA_SYNC_OUT_CTRL_MODE_MASK		(3 << 9)
+#define RA_SYNC_OUT_CTRL_MODE_SHIFT		9
 #define RA_SYNC_OUT_ENABLE			BIT(8)
 #define RA_SYNC_OUT_PHASE_MASK			0xff
 
@@ -44,6 +57,7 @@
 #define RA_SYNC_MAIN_STAT_PLL1_LOCKED		BIT(4)
 #define RA_SYNC_MAIN_STAT_PHASE_ADJUST		BIT(3)
 #define RA_SYNC_MAIN_STAT_PLL1_UNLOCK_S		BIT(0)
+#define RA_SYNC_MAIN_STAT_STICKY		RA_SYNC_MAIN_STAT_PLL1_UNLOCK_S
 
 #define RA_SYNC_MAIN_CTRL			0x44 /* R/W Sync Main Control Register */
 #define RA_SYNC_MAIN_WC_44_1			(0 << 13)
@@ -52,14 +66,20 @@
 #define RA_SYNC_MAIN_WC_96			(3 << 13)
 #define RA_SYNC_MAIN_WC_176_4			(4 << 13)
 #define RA_SYNC_MAIN_WC_192			(5 << 13)
+#define RA_SYNC_MAIN_WC_MASK			(7 << 13)
+#define RA_SYNC_MAIN_WC_SHIFT			13
 #define RA_SYNC_MAIN_GEN_EN			BIT(12)
 #define RA_SYNC_MAIN_GEN_SOURCE_EXT(n)		(n << 8)
+#define RA_SYNC_MAIN_GEN_SOURCE_MASK		(0xf << 8)
+#define RA_SYNC_MAIN_GEN_SOURCE_SHIFT		8
 #define RA_SYNC_MAIN_SYS_44_1			(0 << 4)
 #define RA_SYNC_MAIN_SYS_48			(1 << 4)
 #define RA_SYNC_MAIN_SYS_88_2			(2 << 4)
 #define RA_SYNC_MAIN_SYS_96			(3 << 4)
 #define RA_SYNC_MAIN_SYS_176_4			(4 << 4)
 #define RA_SYNC_MAIN_SYS_192			(5 << 4)
+#define RA_SYNC_MAIN_SYS_MASK			(7 << 4)
+#define RA_SYNC_MAIN_SYS_SHIFT			4
 #define RA_SYNC_MAIN_SYNC_SRC_MASK		(0xf << 0)
 #define RA_SYNC_MAIN_SYNC_SRC_EXT(n)		(n << 0)
 #define RA_SYNC_MAIN_SYNC_SRC_PTP		(0xa << 0)
@@ -87,6 +107,79 @@
 
 #define RA_SYNC_EXT_SRC_CTRL_PHASE_MASK	0xfff
 
+/*
+ * The hard IRQ handler latches RA_SYNC_IRQ_STAT0 along with a timestamp
+ * into 'irqs', and the IRQ thread decodes it into events for the readers
+ * of the misc device.
+ */
+#define RA_SYNC_EVENTS_IRQ_FIFO_SIZE		16
+
+struct ra_sync_irq {
+	u64 timestamp_ns;
+	u32 stat;
+};
+
+struct ra_sync_events {
+	DECLARE_KFIFO(irqs, struct ra_sync_irq, RA_SYNC_EVENTS_IRQ_FIFO_SIZE);
+	spinlock_t		lock;
+	struct list_head	readers;
+	wait_queue_head_t	wait;
+	u32			seq;
+	u64			irq_overflows;
+};
+
+/*
+ * Sync source failover, see struct ra_sync_failover_config. An external
+ * source is usable while it reports a signal and a locked sample rate;
+ * good_since[] holds the jiffies at which it last became usable, and is
+ * 0 while it is not. PTP and the internal generator are always usable.
+ */
+#define RA_SYNC_FAILOVER_POLL_MS		100
+#define RA_SYNC_FAILOVER_DEFAULT_HOLD_OFF_MS	2000
+
+struct ra_sync_failover {
+	struct mutex		lock;
+	struct delayed_work	work;
+	bool			enable;
+	unsigned int		hold_off_ms;
+	unsigned int		n_sources;
+	u8			sources[RA_SYNC_FAILOVER_MAX_SOURCES];
+	unsigned long		good_since[RA_SYNC_N_EXT_SRC];
+	u8			active;
+	u64			switches;
+};
+
+/*
+ * Servo debug capture. The hrtimer is the only producer and the reader
+ * of the data file, serialized by read_lock, the only consumer of the
+ * ring, so neither side needs to take a lock against the other.
+ */
+#define RA_SYNC_CAPTURE_RING_SIZE		4096
+/* readers are woken when a batch is ready or the oldest sample gets stale */
+#define RA_SYNC_CAPTURE_WAKE_BATCH		64
+#define RA_SYNC_CAPTURE_WAKE_LATENCY_NS		(100 * NSEC_PER_MSEC)
+#define RA_SYNC_CAPTURE_MAX_RATE_HZ		10000
+#define RA_SYNC_CAPTURE_DEFAULT_RATE_HZ		1000
+
+struct ra_sync_capture {
+	struct hrtimer		timer;
+	DECLARE_KFIFO_PTR(ring, struct ra_sync_servo_sample);
+	struct mutex		lock;
+	struct mutex		read_lock;
+	wait_queue_head_t	wait;
+	bool			enable;
+	u32			rate_hz;
+	u64			last_wake_ns;
+	u64			samples;
+	u64			overruns;
+	u64			missed;
+};
+
+#define RA_SYNC_MEDIA_CLOCK_DEFAULT_TIMEOUT_MS	1000
+#define RA_SYNC_MEDIA_CLOCK_MAX_TIMEOUT_MS	10000
+/* consecutive locked polls accepted as lock when no unlock was observed */
+#define RA_SYNC_MEDIA_CLOCK_STABLE_POLLS	10
+
 struct ra_sync_priv {
 	struct device		*dev;
 	struct regmap		*regmap;
@@ -94,6 +187,10 @@ struct ra_sync_priv {
 	struct clk		*mclk;
 	struct dentry		*debugfs;
 	struct mutex		mutex;
+	struct ra_sync_events	events;
+	struct ra_sync_failover	failover;
+	struct ra_sync_capture	capture;
+	atomic_t		main_stat_sticky;
 };
 
 #define to_ra_sync_priv(x) \
@@ -101,4 +198,38 @@ struct ra_sync_priv {
 
 int ra_sync_debugfs_init(struct ra_sync_priv *priv);
 
+void ra_sync_events_init(struct ra_sync_priv *priv);
+void ra_sync_events_queue(struct ra_sync_priv *priv, u64 timestamp_ns,
+			  u32 type, int source, u32 status);
+irqreturn_t ra_sync_irq_handler(int irq, void *devid);
+irqreturn_t ra_sync_irq_thread(int irq, void *devid);
+
+struct ra_sync_priv *ra_sync_file_priv(struct file *filp);
+int ra_sync_events_open(struct inode *inode, struct file *filp);
+int ra_sync_events_release(struct inode *inode, struct file *filp);
+ssize_t ra_sync_events_read(struct file *filp, char __user *buf,
+			    size_t count, loff_t *ppos);
+__poll_t ra_sync_events_poll(struct file *filp, poll_table *wait);
+
+int ra_sync_config_get(struct ra_sync_priv *priv,
+		       struct ra_sync_config *config);
+int ra_sync_config_set(struct ra_sync_priv *priv,
+		       const struct ra_sync_config *config);
+int ra_sync_status_get(struct ra_sync_priv *priv,
+		       struct ra_sync_status *status);
+int ra_sync_main_stat_read(struct ra_sync_priv *priv, u32 *stat);
+int ra_sync_media_clock_set(struct ra_sync_priv *priv,
+			    struct ra_sync_media_clock *mc);
+
+int ra_sync_capture_init(struct ra_sync_priv *priv);
+void ra_sync_capture_debugfs_init(struct ra_sync_priv *priv,
+				  struct dentry *root);
+
+int ra_sync_failover_init(struct ra_sync_priv *priv);
+void ra_sync_failover_update(struct ra_sync_priv *priv);
+int ra_sync_failover_set(struct ra_sync_priv *priv,
+			 const struct ra_sync_failover_config *config);
+void ra_sync_failover_get(struct ra_sync_priv *priv,
+			  struct ra_sync_failover_config *config);
+
 #endif /* RA_SYNC_MAIN_H */